@@ -0,0 +1,133 @@
+#pragma once
+
+#include "MemoryConstants.h"
+#include <coroutine>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/*
+ * awaitable version of the virtual memory API (C++20 coroutines).
+ *
+ * accesses to resident pages complete without suspending. a page fault
+ * suspends only the task that took it: the evict / restore run on the swap
+ * workers (PMevictAsync / PMrestoreAsync) while VMScheduler keeps running
+ * the other tasks. all page-table work happens on the thread calling
+ * VMScheduler::Run, so the async and the blocking API must not be used at
+ * the same time.
+ */
+
+template <typename T>
+struct VMTaskResult {
+  T value{};
+  void return_value(T v) { value = std::move(v); }
+  T result() { return std::move(value); }
+};
+
+template <>
+struct VMTaskResult<void> {
+  void return_void() {}
+  void result() {}
+};
+
+/*
+ * lazy coroutine task. it starts running when it's awaited, or when it's
+ * handed to VMScheduler::Spawn.
+ */
+template <typename T = void>
+class VMTask {
+public:
+  struct promise_type : VMTaskResult<T> {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+
+    VMTask get_return_object() {
+      return VMTask(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+        std::coroutine_handle<> next = h.promise().continuation;
+        return next ? next : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { exception = std::current_exception(); }
+  };
+
+  VMTask(VMTask&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+  VMTask(const VMTask&) = delete;
+  VMTask& operator=(const VMTask&) = delete;
+  ~VMTask() {
+    if (handle) handle.destroy();
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+    handle.promise().continuation = awaiting;
+    return handle;
+  }
+  T await_resume() {
+    if (handle.promise().exception) {
+      std::rethrow_exception(handle.promise().exception);
+    }
+    return handle.promise().result();
+  }
+
+private:
+  explicit VMTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+/*
+ * single-threaded scheduler for VM tasks. swap workers hand finished I/O
+ * back through Post; everything else runs inside Run.
+ */
+class VMScheduler {
+public:
+  /*
+   * queues a top-level task. it starts on the next Run.
+   */
+  void Spawn(VMTask<void> task);
+
+  /*
+   * runs until every spawned task has finished.
+   */
+  void Run();
+
+  /*
+   * makes a suspended coroutine runnable again. Schedule must be called
+   * from inside Run, Post may be called from any thread.
+   */
+  void Schedule(std::coroutine_handle<> handle);
+  void Post(std::coroutine_handle<> handle);
+
+  /*
+   * the scheduler currently inside Run on this thread, or nullptr.
+   */
+  static VMScheduler* Current();
+
+private:
+  std::deque<std::coroutine_handle<>> ready;
+  uint64_t live = 0;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<std::coroutine_handle<>> completed;
+};
+
+/*
+ * awaitable VMread / VMwrite. same return values as the blocking calls.
+ */
+VMTask<int> VMreadAsync(uint64_t virtualAddress, word_t* value);
+
+VMTask<int> VMwriteAsync(uint64_t virtualAddress, word_t value);
@@ -0,0 +1,324 @@
+#include "AsyncVirtualMemory.h"
+#include "PhysicalMemory.h"
+#include "VirtualMemoryInternal.h"
+#include <algorithm>
+#include <cassert>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// bookkeeping for faults that are in flight. only touched from inside
+// VMScheduler::Run.
+// the frames a fault holds on to are counted in the protected_frames of the
+// current VMState. each thread running a scheduler has its own.
+struct AsyncVMState {
+  // table entries being filled and pages being evicted / restored
+  std::unordered_set<uint64_t> busy;
+  std::unordered_map<uint64_t, std::vector<std::coroutine_handle<>>> waiters;
+  uint64_t faults_in_flight = 0;
+  std::deque<std::coroutine_handle<>> fault_waiters;
+};
+
+thread_local AsyncVMState async_state;
+
+// every fault pins at most a whole path, keep enough frames evictable.
+// pinned frames can't be evicted, so only the others count. a single fault
+// always fits, the pin cap leaves room for one path plus a victim.
+uint64_t MaxFaultsInFlight() {
+  const VMState& state = CurrentVMState();
+  return std::max<uint64_t>(1, (state.num_frames - state.pinned_count) / (2 * (TABLES_DEPTH + 1)));
+}
+
+thread_local VMScheduler* current_scheduler = nullptr;
+
+uint64_t EntryKey(uint64_t entry) { return entry; }
+
+uint64_t PageKey(uint64_t page) { return RAM_SIZE + page; }
+
+void Reserve(uint64_t frame) {
+  CurrentVMState().protected_frames[frame]++;
+}
+
+void Release(uint64_t frame) {
+  VMState& state = CurrentVMState();
+  assert(state.protected_frames[frame] > 0);
+  state.protected_frames[frame]--;
+}
+
+void Wake(uint64_t key) {
+  async_state.busy.erase(key);
+  auto it = async_state.waiters.find(key);
+  if (it == async_state.waiters.end()) {
+    return;
+  }
+  for (auto handle : it->second) {
+    VMScheduler::Current()->Schedule(handle);
+  }
+  async_state.waiters.erase(it);
+}
+
+// suspends until 'key' is no longer busy
+struct WaitFor {
+  uint64_t key;
+
+  bool await_ready() const { return !async_state.busy.count(key); }
+  void await_suspend(std::coroutine_handle<> handle) {
+    async_state.waiters[key].push_back(handle);
+  }
+  void await_resume() {}
+};
+
+// suspends until another fault may start
+struct FaultSlot {
+  bool await_ready() {
+    if (async_state.faults_in_flight < MaxFaultsInFlight()) {
+      ++async_state.faults_in_flight;
+      return true;
+    }
+    return false;
+  }
+  // the finishing fault hands its slot over, faults_in_flight stays the same
+  void await_suspend(std::coroutine_handle<> handle) {
+    async_state.fault_waiters.push_back(handle);
+  }
+  void await_resume() {}
+};
+
+void ReleaseFaultSlot() {
+  if (async_state.fault_waiters.empty()) {
+    --async_state.faults_in_flight;
+    return;
+  }
+  VMScheduler::Current()->Schedule(async_state.fault_waiters.front());
+  async_state.fault_waiters.pop_front();
+}
+
+// one PMevict / PMrestore on the swap workers
+struct SwapOp {
+  bool restore;
+  uint64_t frame;
+  uint64_t page;
+
+  bool await_ready() const { return false; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    VMScheduler* scheduler = VMScheduler::Current();
+    auto done = [scheduler, handle] { scheduler->Post(handle); };
+    if (restore) {
+      PMrestoreAsync(frame, page, done);
+    } else {
+      PMevictAsync(frame, page, done);
+    }
+  }
+  void await_resume() {}
+};
+
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() {
+      return {std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+DetachedTask RunDetached(VMTask<void> task, uint64_t* live) {
+  co_await task;
+  --*live;
+}
+
+// same as AllocateFrame, but the eviction suspends instead of blocking.
+// the returned frame is reserved for the caller.
+VMTask<uint64_t> AllocateFrameAsync(uint64_t page_to_swap_in) {
+  uint64_t frame;
+  VMState& state = CurrentVMState();
+  if (TakeFreeFrame(state, &frame)) {
+    Reserve(frame);
+    clearFrame(frame);
+    co_return frame;
+  }
+
+  FrameChoice choice = ChooseFrame(page_to_swap_in, state);
+  // MaxFaultsInFlight leaves a victim for every fault
+  assert(choice.frame != 0);
+  Reserve(choice.frame);
+
+  if (choice.evict) {
+    uint64_t key = PageKey(choice.evicted_page);
+    async_state.busy.insert(key);
+    co_await SwapOp{false, choice.frame, choice.evicted_page};
+    Wake(key);
+  }
+  clearFrame(choice.frame);
+  co_return choice.frame;
+}
+
+// maps the path to page_index. the path frames stay reserved while the
+// fault is suspended, so no other fault can reuse or evict them.
+VMTask<void> HandleFault(uint64_t page_index, const uint64_t level_indices[TABLES_DEPTH]) {
+  co_await FaultSlot{};
+
+  for (;;) {
+    std::vector<uint64_t> path;
+    uint64_t current_frame = 0;
+    uint64_t wait_key = 0;
+    bool blocked = false;
+
+    for (int depth = 0; depth < TABLES_DEPTH; ++depth) {
+      uint64_t entry = current_frame * PAGE_SIZE + level_indices[depth];
+      bool leaf = depth == TABLES_DEPTH - 1;
+      word_t next_frame;
+      PMread(entry, &next_frame);
+
+      if (next_frame == 0) {
+        // somebody else is already mapping this entry or moving this page
+        if (async_state.busy.count(EntryKey(entry))) {
+          wait_key = EntryKey(entry);
+          blocked = true;
+          break;
+        }
+        if (leaf && async_state.busy.count(PageKey(page_index))) {
+          wait_key = PageKey(page_index);
+          blocked = true;
+          break;
+        }
+
+        async_state.busy.insert(EntryKey(entry));
+        if (leaf) {
+          async_state.busy.insert(PageKey(page_index));
+        }
+
+        next_frame = co_await AllocateFrameAsync(page_index);
+        if (leaf) {
+          co_await SwapOp{true, (uint64_t)next_frame, page_index};
+          CurrentVMState().faults++;
+        }
+        PMwrite(entry, next_frame);
+
+        Wake(EntryKey(entry));
+        if (leaf) {
+          Wake(PageKey(page_index));
+        }
+      } else {
+        Reserve(next_frame);
+      }
+
+      path.push_back(next_frame);
+      current_frame = next_frame;
+    }
+
+    for (uint64_t frame : path) {
+      Release(frame);
+    }
+    if (!blocked) {
+      break;
+    }
+    co_await WaitFor{wait_key};
+  }
+
+  ReleaseFaultSlot();
+}
+
+// without allocate_if_missing a page that was never written resolves to
+// the zero frame, see MapPage
+VMTask<uint64_t> ResolveAddressAsync(uint64_t virtualAddress, bool allocate_if_missing) {
+  uint64_t page_index, offset;
+  SplitOffsetPage(virtualAddress, &page_index, &offset);
+
+  uint64_t level_indices[TABLES_DEPTH];
+  SplitPageIndexByLevels(page_index, level_indices);
+
+  for (;;) {
+    uint64_t current_frame = 0;
+    int depth = 0;
+    for (; depth < TABLES_DEPTH; ++depth) {
+      word_t next_frame;
+      PMread(current_frame * PAGE_SIZE + level_indices[depth], &next_frame);
+      if (next_frame == 0) {
+        break;
+      }
+      current_frame = next_frame;
+    }
+
+    // resident, nothing to wait for
+    if (depth == TABLES_DEPTH) {
+      co_return current_frame * PAGE_SIZE + offset;
+    }
+    // a page on its way to swap isn't in there yet, so wait for it first
+    if (!allocate_if_missing && !async_state.busy.count(PageKey(page_index)) &&
+        !PMisSwapped(page_index)) {
+      co_return ZERO_FRAME * PAGE_SIZE + offset;
+    }
+
+    co_await HandleFault(page_index, level_indices);
+  }
+}
+
+}  // namespace
+
+void VMScheduler::Spawn(VMTask<void> task) {
+  ++live;
+  ready.push_back(RunDetached(std::move(task), &live).handle);
+}
+
+void VMScheduler::Run() {
+  VMScheduler* outer = current_scheduler;
+  current_scheduler = this;
+
+  while (live > 0) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      if (ready.empty()) {
+        cv.wait(lock, [this] { return !completed.empty(); });
+      }
+      ready.insert(ready.end(), completed.begin(), completed.end());
+      completed.clear();
+    }
+
+    while (!ready.empty()) {
+      std::coroutine_handle<> handle = ready.front();
+      ready.pop_front();
+      handle.resume();
+    }
+  }
+
+  current_scheduler = outer;
+}
+
+void VMScheduler::Schedule(std::coroutine_handle<> handle) {
+  ready.push_back(handle);
+}
+
+void VMScheduler::Post(std::coroutine_handle<> handle) {
+  // notify under the lock, Run may return and the scheduler go away right after
+  std::lock_guard<std::mutex> lock(mutex);
+  completed.push_back(handle);
+  cv.notify_one();
+}
+
+VMScheduler* VMScheduler::Current() {
+  return current_scheduler;
+}
+
+VMTask<int> VMreadAsync(uint64_t virtualAddress, word_t* value) {
+  assert(virtualAddress < VIRTUAL_MEMORY_SIZE);
+  uint64_t phys_addr = co_await ResolveAddressAsync(virtualAddress, false);
+  if (phys_addr >= RAM_SIZE) {
+    *value = zero_frame[phys_addr % PAGE_SIZE];
+    co_return 1;
+  }
+  PMread(phys_addr, value);
+  co_return 1;
+}
+
+VMTask<int> VMwriteAsync(uint64_t virtualAddress, word_t value) {
+  assert(virtualAddress < VIRTUAL_MEMORY_SIZE);
+  uint64_t phys_addr = co_await ResolveAddressAsync(virtualAddress, true);
+  PMwrite(phys_addr, value);
+  co_return 1;
+}
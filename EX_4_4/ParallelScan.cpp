@@ -0,0 +1,212 @@
+#include "PhysicalMemory.h"
+#include "VirtualMemoryInternal.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// tables this close to the root are handed out as separate tasks, deeper
+// ones are walked by whoever picked up their subtree
+#define SCAN_SPLIT_DEPTH 2
+
+namespace {
+
+// every task carries the physical memory it reads: a worker still draining
+// after the previous scan may pick up the first tasks of the next one
+struct ScanTask {
+  PMInstance* instance;
+  uint64_t frame;
+  uint64_t depth;
+  uint64_t page_path;
+  uint64_t parent_entry;
+};
+
+struct ScanRecord {
+  uint64_t frame;
+  uint64_t page_path;
+  uint64_t parent_entry;
+  bool leaf;
+  bool empty;
+};
+
+// the owner pushes and pops at the back, thieves take from the front
+struct WorkQueue {
+  std::mutex mutex;
+  std::deque<ScanTask> tasks;
+};
+
+class ScanPool {
+public:
+  explicit ScanPool(unsigned threads)
+      : queues(threads), results(threads) {
+    for (unsigned id = 1; id < threads; ++id) {
+      workers.emplace_back([this, id] { WorkerLoop(id); });
+    }
+  }
+
+  ~ScanPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    cv.notify_all();
+    for (auto& t : workers) {
+      t.join();
+    }
+  }
+
+  unsigned Threads() const { return queues.size(); }
+
+  // the calling thread works as worker 0
+  void Scan(uint64_t root_frame, FrameScan& scan) {
+    for (auto& records : results) {
+      records.clear();
+    }
+    Push(0, {PMgetInstance(), root_frame, 0, 0, 0});
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++generation;
+    }
+    cv.notify_all();
+
+    Drain(0);
+
+    // every record was appended before its task was counted as done
+    for (const auto& records : results) {
+      for (const ScanRecord& r : records) {
+        scan.used_frames[r.frame] = true;
+        scan.max_frame = std::max(scan.max_frame, r.frame);
+        scan.parent_entry[r.frame] = r.parent_entry;
+        if (r.leaf) {
+          scan.leaf_frames[r.frame] = true;
+          scan.page_per_frame[r.frame] = r.page_path;
+        } else {
+          scan.empty_tables[r.frame] = r.empty;
+        }
+      }
+    }
+  }
+
+private:
+  void WorkerLoop(unsigned id) {
+    uint64_t seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping) {
+          return;
+        }
+        seen = generation;
+      }
+      Drain(id);
+    }
+  }
+
+  void Push(unsigned id, const ScanTask& task) {
+    pending.fetch_add(1);
+    std::lock_guard<std::mutex> lock(queues[id].mutex);
+    queues[id].tasks.push_back(task);
+  }
+
+  bool Pop(unsigned id, ScanTask* task) {
+    {
+      WorkQueue& own = queues[id];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.tasks.empty()) {
+        *task = own.tasks.back();
+        own.tasks.pop_back();
+        return true;
+      }
+    }
+    for (unsigned i = 1; i < queues.size(); ++i) {
+      WorkQueue& victim = queues[(id + i) % queues.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty()) {
+        *task = victim.tasks.front();
+        victim.tasks.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Drain(unsigned id) {
+    while (pending.load() > 0) {
+      ScanTask task;
+      if (Pop(id, &task)) {
+        // worker 0 is the scanning thread, it's bound already
+        if (id != 0) {
+          PMsetInstance(task.instance);
+        }
+        Visit(id, task);
+        if (id != 0) {
+          PMsetInstance(nullptr);
+        }
+        pending.fetch_sub(1);
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  // walks the subtree under 'task', splitting off shallow tables
+  void Visit(unsigned id, const ScanTask& task) {
+    std::vector<ScanTask> stack{task};
+    while (!stack.empty()) {
+      ScanTask curr = stack.back();
+      stack.pop_back();
+
+      if (curr.depth == TABLES_DEPTH) {
+        results[id].push_back({curr.frame, curr.page_path, curr.parent_entry, true, false});
+        continue;
+      }
+
+      bool empty = true;
+      for (uint64_t offset = 0; offset < PAGE_SIZE; ++offset) {
+        uint64_t addr = curr.frame * PAGE_SIZE + offset;
+        word_t next;
+        PMread(addr, &next);
+        if (next == 0) {
+          continue;
+        }
+        empty = false;
+        ScanTask child = {curr.instance, (uint64_t)next, curr.depth + 1,
+                          (curr.page_path << OFFSET_WIDTH) | offset, addr};
+        if (child.depth <= SCAN_SPLIT_DEPTH && child.depth < TABLES_DEPTH) {
+          Push(id, child);
+        } else {
+          stack.push_back(child);
+        }
+      }
+      results[id].push_back({curr.frame, curr.page_path, curr.parent_entry, false, empty});
+    }
+  }
+
+  std::vector<WorkQueue> queues;
+  // per-worker buffers, merged once the scan is done
+  std::vector<std::vector<ScanRecord>> results;
+  std::atomic<uint64_t> pending{0};
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint64_t generation = 0;
+  bool stopping = false;
+};
+
+}  // namespace
+
+void ParallelScanUsedFrames(uint64_t root_frame, FrameScan& scan, unsigned threads) {
+  // one pool per calling thread, VM instances on different threads scan at
+  // the same time
+  static thread_local std::unique_ptr<ScanPool> pool;
+  if (!pool || pool->Threads() != threads) {
+    pool.reset();
+    pool = std::make_unique<ScanPool>(threads);
+  }
+  pool->Scan(root_frame, scan);
+}
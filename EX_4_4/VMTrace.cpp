@@ -0,0 +1,138 @@
+#include "VMTrace.h"
+#include "VirtualMemory.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef VM_TRACE
+
+namespace {
+
+const char* phase_names[TRACE_PHASES] = {
+    "access", "walk", "allocate", "scan", "table search",
+    "victim search", "reclaim", "evict", "restore",
+};
+
+struct TraceEvent {
+  uint64_t begin;
+  uint64_t end;
+  TracePhase phase;
+};
+
+// written by its thread only, read once the threads are out of the VM
+struct TraceRing {
+  std::vector<TraceEvent> events = std::vector<TraceEvent>(VM_TRACE_EVENTS);
+  uint64_t written = 0;
+};
+
+// rings outlive their threads, the events of a finished thread still count
+std::mutex rings_mutex;
+std::vector<std::shared_ptr<TraceRing>> rings;
+
+thread_local TraceRing* thread_ring = nullptr;
+
+// the same moment in ticks and on the steady clock, to convert ticks later
+struct Calibration {
+  uint64_t ticks = TraceTicks();
+  std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+};
+Calibration start;
+
+double NanosPerTick() {
+  uint64_t ticks = TraceTicks();
+  auto time = std::chrono::steady_clock::now();
+  if (ticks == start.ticks) {
+    return 1;
+  }
+  return std::chrono::duration<double, std::nano>(time - start.time).count() / (ticks - start.ticks);
+}
+
+// events in the order they were written, per thread
+template <typename F>
+void ForEachEvent(F f) {
+  std::lock_guard<std::mutex> lock(rings_mutex);
+  for (uint64_t tid = 0; tid < rings.size(); ++tid) {
+    const TraceRing& ring = *rings[tid];
+    uint64_t first = ring.written > VM_TRACE_EVENTS ? ring.written - VM_TRACE_EVENTS : 0;
+    for (uint64_t i = first; i < ring.written; ++i) {
+      f(tid, ring.events[i % VM_TRACE_EVENTS]);
+    }
+  }
+}
+
+}  // namespace
+
+void TraceRecord(TracePhase phase, uint64_t begin, uint64_t end) {
+  if (thread_ring == nullptr) {
+    auto ring = std::make_shared<TraceRing>();
+    thread_ring = ring.get();
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    rings.push_back(std::move(ring));
+  }
+  thread_ring->events[thread_ring->written % VM_TRACE_EVENTS] = {begin, end, phase};
+  thread_ring->written++;
+}
+
+int VMtraceExport(const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file == nullptr) return 0;
+
+  double nanos_per_tick = NanosPerTick();
+  bool first = true;
+  fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  ForEachEvent([&](uint64_t tid, const TraceEvent& event) {
+    // complete events, timestamps in microseconds
+    fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %llu, "
+                  "\"ts\": %.3f, \"dur\": %.3f}",
+            first ? "" : ",\n", phase_names[event.phase], (long long unsigned) tid,
+            (event.begin - start.ticks) * nanos_per_tick / 1e3,
+            (event.end - event.begin) * nanos_per_tick / 1e3);
+    first = false;
+  });
+  fprintf(file, "\n]}\n");
+  return fclose(file) == 0;
+}
+
+void VMtracePrintSummary() {
+  std::vector<uint64_t> durations[TRACE_PHASES];
+  ForEachEvent([&](uint64_t, const TraceEvent& event) {
+    durations[event.phase].push_back(event.end - event.begin);
+  });
+
+  double nanos_per_tick = NanosPerTick();
+  printf("%-14s %10s %12s %12s %12s\n", "phase", "count", "p50 (ns)", "p99 (ns)", "max (ns)");
+  for (int phase = 0; phase < TRACE_PHASES; ++phase) {
+    std::vector<uint64_t>& d = durations[phase];
+    if (d.empty()) {
+      continue;
+    }
+    std::sort(d.begin(), d.end());
+    printf("%-14s %10zu %12.0f %12.0f %12.0f\n", phase_names[phase], d.size(),
+           d[d.size() / 2] * nanos_per_tick, d[d.size() * 99 / 100] * nanos_per_tick,
+           d.back() * nanos_per_tick);
+  }
+}
+
+void VMtraceReset() {
+  std::lock_guard<std::mutex> lock(rings_mutex);
+  for (auto& ring : rings) {
+    ring->written = 0;
+  }
+}
+
+#else
+
+int VMtraceExport(const char*) {
+  return 0;
+}
+
+void VMtracePrintSummary() {
+  printf("tracing is off, build with -DVM_TRACE\n");
+}
+
+void VMtraceReset() {}
+
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * trace points on the access / fault path. they compile to nothing unless
+ * the VM is built with -DVM_TRACE. each one records the cycle counter at
+ * the start and the end of its scope into a ring buffer of the calling
+ * thread; see VMtraceExport / VMtracePrintSummary for reading them out.
+ */
+
+enum TracePhase {
+  // a whole ResolveAddress
+  TRACE_ACCESS,
+  // walking the levels in MapPage, faults included
+  TRACE_WALK,
+  // a whole AllocateFrame
+  TRACE_ALLOCATE,
+  // ScanUsedFramesForEvict, sequential or parallel
+  TRACE_SCAN,
+  // looking for an empty table, an unused frame or max + 1
+  TRACE_TABLE_SEARCH,
+  // picking the page to evict
+  TRACE_VICTIM_SEARCH,
+  // batch refill of the free frames
+  TRACE_RECLAIM,
+  TRACE_EVICT,
+  TRACE_RESTORE,
+  TRACE_PHASES
+};
+
+// events each thread keeps, older ones are overwritten
+#define VM_TRACE_EVENTS (1 << 16)
+
+#ifdef VM_TRACE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+inline uint64_t TraceTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t ticks;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+void TraceRecord(TracePhase phase, uint64_t begin, uint64_t end);
+
+class TraceScope {
+public:
+  explicit TraceScope(TracePhase phase) : phase(phase), begin(TraceTicks()) {}
+  ~TraceScope() { TraceRecord(phase, begin, TraceTicks()); }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+  TracePhase phase;
+  uint64_t begin;
+};
+
+#define VM_TRACE_CONCAT_(a, b) a##b
+#define VM_TRACE_CONCAT(a, b) VM_TRACE_CONCAT_(a, b)
+#define VM_TRACE_SCOPE(phase) TraceScope VM_TRACE_CONCAT(trace_scope_, __LINE__)(phase)
+
+#else
+
+#define VM_TRACE_SCOPE(phase) do {} while (0)
+
+#endif
@@ -1,15 +1,57 @@
 #include "PhysicalMemory.h"
 #include "VirtualMemory.h"
 # include "MemoryConstants.h"
+#include "VirtualMemoryInternal.h"
+#include "VMTrace.h"
 #include <cassert>
 #include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
+const word_t zero_frame[PAGE_SIZE] = {0};
+// below this the sequential scan beats handing out work to threads
+#define PARALLEL_SCAN_MIN_FRAMES (1LL << 12)
+// pins must leave enough frames for the path of a fault plus one victim
+#define MAX_PINNED_FRAMES(state) ((state).num_frames - TABLES_DEPTH - 2)
+// pages brought in after a fault inside a SEQUENTIAL range
+#define READ_AHEAD_PAGES 4
+
+struct Reclaimer {
+  std::thread thread;
+  std::condition_variable cv;
+  bool requested = false;
+  bool stopping = false;
+};
+
+// one virtual memory and the physical memory under it, see VMcreateInstance
+struct VMInstance {
+  VMState state;
+  // the background reclaimer changes the tables too, every public call holds this
+  std::mutex mutex;
+  Reclaimer reclaimer;
+  // nullptr for the default physical memory
+  PMInstance* pm = nullptr;
 
-struct VMState {
-    bool protected_frames[NUM_FRAMES] = {false};
+  ~VMInstance();
 };
 
+static thread_local VMInstance* bound_instance = nullptr;
+
+VMInstance& Instance() {
+  static VMInstance default_instance;
+  return bound_instance != nullptr ? *bound_instance : default_instance;
+}
+
+VMState& CurrentVMState() {
+  return Instance().state;
+}
+
 void VMinitialize() {
   // Initialize the virtual memory
+  std::lock_guard<std::mutex> lock(Instance().mutex);
   for (uint64_t i = 0; i < PAGE_SIZE; ++i) {
     PMwrite(i, 0);
   }
@@ -24,7 +66,8 @@ void SplitOffsetPage(uint64_t virtualAddress, uint64_t* pageIndex, uint64_t* off
 void ComputeBitsPerLevel(uint64_t bitsPerLevel[TABLES_DEPTH]) {
   int totalBits = VIRTUAL_ADDRESS_WIDTH - OFFSET_WIDTH;
   int remainder = totalBits % OFFSET_WIDTH;
-  bitsPerLevel[0] = remainder;
+  // the root takes whatever doesn't divide evenly, or a full level if it does
+  bitsPerLevel[0] = remainder == 0 ? OFFSET_WIDTH : remainder;
   for (int i = 1; i < TABLES_DEPTH; ++i) {
     bitsPerLevel[i] = OFFSET_WIDTH;
   }
@@ -43,19 +86,8 @@ void SplitPageIndexByLevels(uint64_t pageIndex, uint64_t levelIndices[TABLES_DEP
   }
 }
 
-bool CheckEmptyTable(uint64_t frameIndex) {
-  for (int i = 0; i < PAGE_SIZE; ++i) {
-    word_t value;
-    PMread(frameIndex * PAGE_SIZE + i, &value);
-    if (value != 0) {
-      return false;  // Found a non-zero entry → table not empty
-    }
-  }
-  return true;  // All entries are 0 → table is empty
-}
-
-bool ShouldUseMaxFrame(uint64_t MaxFrameIndex){
-  return MaxFrameIndex + 1 < NUM_FRAMES;
+bool ShouldUseMaxFrame(uint64_t MaxFrameIndex, const VMState& state){
+  return MaxFrameIndex + 1 < state.num_frames;
 }
 
 void clearFrame(uint64_t frame) {
@@ -120,42 +152,6 @@ void clearFrame(uint64_t frame) {
 
 #include <unordered_set>
 
-void FindMaxFrame(uint64_t root_frame, uint64_t* max_frame_seen) {
-  using FrameInfo = std::pair<uint64_t, uint64_t>; // (frame, depth)
-  std::stack<FrameInfo> stack;
-  std::unordered_set<uint64_t> visited;
-
-  stack.push({root_frame, 0});
-
-  while (!stack.empty()) {
-    auto [curr_frame, depth] = stack.top();
-    stack.pop();
-
-    if (visited.count(curr_frame)) {
-      continue;
-    }
-    visited.insert(curr_frame);
-
-    // לא נחשב את frame 0 כ-max
-    if (curr_frame != 0 && curr_frame > *max_frame_seen) {
-      *max_frame_seen = curr_frame;
-    }
-
-    for (uint64_t offset = 0; offset < PAGE_SIZE; ++offset) {
-      uint64_t addr = curr_frame * PAGE_SIZE + offset;
-      if (addr >= NUM_FRAMES * PAGE_SIZE) {
-        continue; // הגנה על גישה לא חוקית
-      }
-
-      word_t next;
-      PMread(addr, &next);
-      if (next != 0) {
-        stack.push({next, depth + 1});
-      }
-    }
-  }
-}
-
 
 //
 //void ScanUsedFramesForEvict(
@@ -187,12 +183,18 @@ void FindMaxFrame(uint64_t root_frame, uint64_t* max_frame_seen) {
 #include <unordered_set>
 
 
-void ScanUsedFramesForEvict(
-    uint64_t root_frame,
-    bool used_frames[NUM_FRAMES],
-    uint64_t page_per_frame[NUM_FRAMES]
-) {
-  printf("here?");
+void ScanUsedFramesForEvict(uint64_t root_frame, FrameScan& scan) {
+  VM_TRACE_SCOPE(TRACE_SCAN);
+  const VMState& state = CurrentVMState();
+  unsigned threads = state.scan_threads;
+  if (threads == 0) {
+    threads = state.num_frames >= PARALLEL_SCAN_MIN_FRAMES ? std::thread::hardware_concurrency() : 1;
+  }
+  if (threads > 1) {
+    ParallelScanUsedFrames(root_frame, scan, threads);
+    return;
+  }
+
   using FrameState = std::tuple<uint64_t, uint64_t, uint64_t>; // (frame, depth, page_path)
   std::stack<FrameState> stack;
   std::unordered_set<uint64_t> visited;
@@ -207,14 +209,17 @@ void ScanUsedFramesForEvict(
     }
     visited.insert(curr_frame);
 
-    used_frames[curr_frame] = true;
+    scan.used_frames[curr_frame] = true;
+    scan.max_frame = std::max(scan.max_frame, curr_frame);
 
-    if (depth == TABLES_DEPTH - 1) {
-      page_per_frame[curr_frame] = page_path;
-      printf("ScanUsedFrames: frame %llu now maps to page %llu\n", curr_frame, page_path);
+    // frames below the last table level hold data, not entries
+    if (depth == TABLES_DEPTH) {
+      scan.leaf_frames[curr_frame] = true;
+      scan.page_per_frame[curr_frame] = page_path;
       continue;
     }
 
+    bool empty = true;
     for (uint64_t offset = 0; offset < PAGE_SIZE; ++offset) {
       uint64_t addr = curr_frame * PAGE_SIZE + offset;
       if (addr >= NUM_FRAMES * PAGE_SIZE) {
@@ -224,17 +229,20 @@ void ScanUsedFramesForEvict(
       word_t next;
       PMread(addr, &next);
       if (next != 0) {
+        empty = false;
         uint64_t new_page_path = (page_path << OFFSET_WIDTH) | offset;
-        stack.push({next, depth + 1, new_page_path});
+        scan.parent_entry[next] = addr;
+        stack.push({(uint64_t)next, depth + 1, new_page_path});
       }
     }
+    scan.empty_tables[curr_frame] = empty;
   }
 }
 
 
 uint64_t CyclicalDistance(uint64_t a, uint64_t b) {
   uint64_t d = (a > b) ? a - b : b - a;
-  return std::min(d, NUM_PAGES - d);
+  return std::min(d, (uint64_t)NUM_PAGES - d);
 }
 
 void RemoveReference(uint64_t frame_to_remove, uint64_t curr_frame, uint64_t depth, bool visited[NUM_FRAMES]) {
@@ -256,74 +264,236 @@ void RemoveReference(uint64_t frame_to_remove, uint64_t curr_frame, uint64_t dep
 }
 
 
-uint64_t AllocateFrame(uint64_t page_to_swap_in, uint64_t parent_frame,
-                       uint64_t parent_offset, VMState& state) {
-  // Allocate a new frame for the given page, either by finding an empty table or evicting an existing one
+bool IsFrameProtected(const VMState& state, uint64_t frame) {
+  return state.protected_frames[frame] > 0 || state.pinned_frames[frame] > 0;
+}
 
-  uint64_t max_frame = 0;
-  FindMaxFrame(0, &max_frame);
-  printf("AllocateFrame: max frame seen is %llu\n", max_frame);
+AdviceRange* FindAdvice(VMState& state, uint64_t page_index) {
+  for (AdviceRange& range : state.advice_ranges) {
+    if (range.first_page <= page_index && page_index <= range.last_page) {
+      return &range;
+    }
+  }
+  return nullptr;
+}
 
-  // First, try to find an empty table that is not protected
-  for (uint64_t f = 1; f <= max_frame; ++f) {
-    if (CheckEmptyTable(f) && !state.protected_frames[f]) {
-      printf("bool for protected is: %d\n", state.protected_frames[f]);
-      printf("i use now frame %llu:\n", f);
-      return f;
+// a sequential scan has already gone past this page
+bool IsBehindCursor(const VMState& state, uint64_t page_index) {
+  for (const AdviceRange& range : state.advice_ranges) {
+    if (range.advice == VM_ADVICE_SEQUENTIAL &&
+        range.first_page <= page_index && page_index < range.cursor) {
+      return true;
     }
   }
+  return false;
+}
+
+FrameChoice ChooseFrame(uint64_t page_to_swap_in, const VMState& state) {
+  FrameScan scan;
+  ScanUsedFramesForEvict(0, scan);
 
-  // If there's space for a new frame
-  if (ShouldUseMaxFrame(max_frame)) {
-    uint64_t new_frame = max_frame + 1;
-    printf("AllocateFrame: using new frame %llu\n", new_frame);
-    clearFrame(new_frame);
-    return new_frame;
+  {
+    VM_TRACE_SCOPE(TRACE_TABLE_SEARCH);
+
+    // First, try to find an empty table that is not protected
+    for (uint64_t f = 1; f <= scan.max_frame; ++f) {
+      if (scan.empty_tables[f] && !IsFrameProtected(state, f)) {
+        PMwrite(scan.parent_entry[f], 0);
+        return {f, false, 0};
+      }
+    }
+
+    // frames nothing points at anymore (VM_ADVICE_DONTNEED)
+    for (uint64_t f = 1; f < scan.max_frame; ++f) {
+      if (!scan.used_frames[f] && !IsFrameProtected(state, f)) {
+        return {f, false, 0};
+      }
+    }
+
+    // frames handed out but not linked yet (in-flight async faults) are taken too
+    uint64_t max_frame = scan.max_frame;
+    for (uint64_t f = max_frame + 1; f < state.num_frames; ++f) {
+      if (state.protected_frames[f] > 0) {
+        max_frame = f;
+      }
+    }
+
+    // If there's space for a new frame
+    if (ShouldUseMaxFrame(max_frame, state)) {
+      return {max_frame + 1, false, 0};
+    }
   }
 
-  // Else, find a frame to evict
+  // Else, find a frame to evict. pages behind a sequential cursor go first
+  VM_TRACE_SCOPE(TRACE_VICTIM_SEARCH);
   uint64_t max_distance = 0;
   uint64_t frame_to_evict = 0;
-  bool used_frames[NUM_FRAMES] = {false};
-  uint64_t page_per_frame[NUM_FRAMES] = {0};
-  ScanUsedFramesForEvict(0, used_frames, page_per_frame);
+  bool evict_behind = false;
 
-  for (uint64_t f = 1; f < NUM_FRAMES; ++f) {
-    if (!used_frames[f] || state.protected_frames[f] || page_per_frame[f] == 0) {
+  for (uint64_t f = 1; f < state.num_frames; ++f) {
+    if (!scan.leaf_frames[f] || IsFrameProtected(state, f)) {
       continue;
     }
 
-    uint64_t p = page_per_frame[f];
+    uint64_t p = scan.page_per_frame[f];
     uint64_t cyclical_dist = CyclicalDistance(page_to_swap_in, p);
+    bool behind = IsBehindCursor(state, p);
 
-    if (cyclical_dist > max_distance) {
+    if (frame_to_evict == 0 || behind > evict_behind ||
+        (behind == evict_behind && cyclical_dist > max_distance)) {
       max_distance = cyclical_dist;
       frame_to_evict = f;
+      evict_behind = behind;
     }
   }
+  if (frame_to_evict == 0) {
+    // every leaf is protected or pinned
+    return {0, false, 0};
+  }
 
-  PMevict(frame_to_evict, page_per_frame[frame_to_evict]);
-  printf("frame to evict %llu: \n", frame_to_evict);
+  PMwrite(scan.parent_entry[frame_to_evict], 0);
+  return {frame_to_evict, true, scan.page_per_frame[frame_to_evict]};
+}
 
-  PMwrite(parent_frame * PAGE_SIZE + parent_offset, 0);
-  clearFrame(frame_to_evict);
-  assert(frame_to_evict < NUM_FRAMES);
+bool TakeFreeFrame(VMState& state, uint64_t* frame) {
+  if (state.free_frames.empty()) {
+    return false;
+  }
+  *frame = state.free_frames.back();
+  state.free_frames.pop_back();
+  state.protected_frames[*frame]--;
+  return true;
+}
 
-  return frame_to_evict;
+// tops state.free_frames up to the high watermark with a single scan. empty
+// tables and unused frames go first, then pages are evicted in the same order
+// ChooseFrame would pick them one at a time.
+void ReclaimFrames(uint64_t page_to_swap_in, VMState& state) {
+  VM_TRACE_SCOPE(TRACE_RECLAIM);
+  if (state.free_frames.size() >= state.high_watermark) {
+    return;
+  }
+  uint64_t wanted = state.high_watermark - state.free_frames.size();
+
+  FrameScan scan;
+  ScanUsedFramesForEvict(0, scan);
+
+  auto give = [&](uint64_t f) {
+    state.protected_frames[f]++;
+    state.free_frames.push_back(f);
+    wanted--;
+  };
+
+  for (uint64_t f = 1; f <= scan.max_frame && wanted > 0; ++f) {
+    if (scan.empty_tables[f] && !IsFrameProtected(state, f)) {
+      PMwrite(scan.parent_entry[f], 0);
+      give(f);
+    }
+  }
+  for (uint64_t f = 1; f < state.num_frames && wanted > 0; ++f) {
+    if (!scan.used_frames[f] && !IsFrameProtected(state, f)) {
+      give(f);
+    }
+  }
+  if (wanted == 0) {
+    return;
+  }
+
+  std::vector<uint64_t> victims;
+  for (uint64_t f = 1; f < state.num_frames; ++f) {
+    if (scan.leaf_frames[f] && !IsFrameProtected(state, f)) {
+      victims.push_back(f);
+    }
+  }
+  uint64_t batch = std::min<uint64_t>(wanted, victims.size());
+  std::partial_sort(victims.begin(), victims.begin() + batch, victims.end(),
+                    [&](uint64_t a, uint64_t b) {
+    uint64_t page_a = scan.page_per_frame[a], page_b = scan.page_per_frame[b];
+    bool behind_a = IsBehindCursor(state, page_a), behind_b = IsBehindCursor(state, page_b);
+    if (behind_a != behind_b) {
+      return behind_a;
+    }
+    return CyclicalDistance(page_to_swap_in, page_a) > CyclicalDistance(page_to_swap_in, page_b);
+  });
+
+  for (uint64_t i = 0; i < batch; ++i) {
+    uint64_t f = victims[i];
+    PMwrite(scan.parent_entry[f], 0);
+    {
+      VM_TRACE_SCOPE(TRACE_EVICT);
+      PMevict(f, scan.page_per_frame[f]);
+    }
+    give(f);
+  }
 }
 
+uint64_t AllocateFrame(uint64_t page_to_swap_in, VMState& state) {
+  // Allocate a new frame for the given page, either by finding an empty table or evicting an existing one
+  VM_TRACE_SCOPE(TRACE_ALLOCATE);
+  state.last_fault_page = page_to_swap_in;
+  if (state.free_frames.size() < state.low_watermark) {
+    Reclaimer& reclaimer = Instance().reclaimer;
+    if (reclaimer.thread.joinable()) {
+      reclaimer.requested = true;
+      reclaimer.cv.notify_one();
+    } else {
+      ReclaimFrames(page_to_swap_in, state);
+    }
+  }
 
+  uint64_t frame;
+  if (!TakeFreeFrame(state, &frame)) {
+    FrameChoice choice = ChooseFrame(page_to_swap_in, state);
+    if (choice.frame == 0) {
+      return 0;
+    }
+    if (choice.evict) {
+      VM_TRACE_SCOPE(TRACE_EVICT);
+      PMevict(choice.frame, choice.evicted_page);
+    }
+    frame = choice.frame;
+  }
+  clearFrame(frame);
+  return frame;
+}
 
-uint64_t ResolveAddress(uint64_t virtualAddress, VMState& state) {
-  uint64_t page_index, offset;
-  SplitOffsetPage(virtualAddress, &page_index, &offset);
 
+
+// fills 'path' with the frames leading to page_index, without mapping
+// anything. false if the page isn't resident.
+bool WalkPath(uint64_t page_index, uint64_t path[TABLES_DEPTH]) {
+  uint64_t level_indices[TABLES_DEPTH];
+  SplitPageIndexByLevels(page_index, level_indices);
+
+  uint64_t current_frame = 0;
+  for (int depth = 0; depth < TABLES_DEPTH; ++depth) {
+    word_t next_frame;
+    PMread(current_frame * PAGE_SIZE + level_indices[depth], &next_frame);
+    if (next_frame == 0) {
+      return false;
+    }
+    current_frame = next_frame;
+    path[depth] = current_frame;
+  }
+  return true;
+}
+
+// maps page_index and returns its frame. 'faulted' is set if the page
+// itself wasn't resident. without allocate_if_missing, a page that was never
+// written (not mapped, nothing in swap) resolves to ZERO_FRAME instead.
+// returns 0 if a frame was needed and every candidate is protected; the
+// tables mapped on the way stay and are reclaimed as empty tables later.
+uint64_t MapPage(uint64_t page_index, VMState& state, bool* faulted,
+                 bool allocate_if_missing) {
+  VM_TRACE_SCOPE(TRACE_WALK);
   uint64_t level_indices[TABLES_DEPTH];
   SplitPageIndexByLevels(page_index, level_indices);
-  printf("page index: %llu ", page_index);
-  printf("offset: %llu \n", offset);
 
+  // the frames on this access' path are off limits until it's done
+  uint64_t path[TABLES_DEPTH];
+  int mapped = 0;
   uint64_t current_frame = 0;
+  *faulted = false;
 
   for (int depth = 0; depth < TABLES_DEPTH; ++depth) {
     uint64_t idx = level_indices[depth];
@@ -331,42 +501,514 @@ uint64_t ResolveAddress(uint64_t virtualAddress, VMState& state) {
     PMread(current_frame * PAGE_SIZE + idx, &next_frame);
 
     if (next_frame == 0) {
-      next_frame = AllocateFrame(page_index, current_frame, idx, state);
-      state.protected_frames[next_frame] = true;
+      if (!allocate_if_missing && !PMisSwapped(page_index)) {
+        current_frame = ZERO_FRAME;
+        break;
+      }
+      next_frame = AllocateFrame(page_index, state);
+      if (next_frame == 0) {
+        current_frame = 0;
+        break;
+      }
       PMwrite(current_frame * PAGE_SIZE + idx, next_frame);
 
       if (depth == TABLES_DEPTH - 1) {
+        VM_TRACE_SCOPE(TRACE_RESTORE);
         PMrestore(next_frame, page_index);
+        *faulted = true;
+        state.faults++;
       }
     }
 
     current_frame = next_frame;
+    path[mapped++] = current_frame;
+    state.protected_frames[current_frame]++;
+
+    assert(current_frame < state.num_frames);
+  }
+
+  for (int depth = 0; depth < mapped; ++depth) {
+    state.protected_frames[path[depth]]--;
+  }
+
+  return current_frame;
+}
+
+// brings in the swapped out pages after page_index, up to the end of the
+// range. pages that were never written read as 0 and stay unmapped until
+// their first VMwrite. stops early once a page can't get a frame, read-ahead
+// is only a hint.
+void ReadAhead(const AdviceRange& range, uint64_t page_index, VMState& state) {
+  uint64_t last = std::min(range.last_page, page_index + READ_AHEAD_PAGES);
+  for (uint64_t next = page_index + 1; next <= last; ++next) {
+    // a swapped out page is never mapped as well
+    if (PMisSwapped(next)) {
+      bool faulted;
+      if (MapPage(next, state, &faulted, true) == 0) {
+        return;
+      }
+    }
+  }
+}
+
+// after a fault in a SEQUENTIAL range, brings in the swapped out pages of the
+// same swap cluster. PMrestore reads the cluster once, so the neighbours come
+// out of that read. they share the leaf table with page_index and only go
+// into empty tables and unused frames, never into the free frames kept for
+// faults and never at the cost of an eviction.
+void RestoreCluster(uint64_t page_index, VMState& state) {
+  uint64_t path[TABLES_DEPTH];
+  if (!WalkPath(page_index, path)) {
+    return;
+  }
+  uint64_t leaf_table = TABLES_DEPTH > 1 ? path[TABLES_DEPTH - 2] : 0;
+
+  uint64_t first = page_index - page_index % SWAP_CLUSTER_PAGES;
+  std::vector<uint64_t> swapped;
+  for (uint64_t page = first; page < first + SWAP_CLUSTER_PAGES && page < NUM_PAGES; ++page) {
+    if (page != page_index && PMisSwapped(page)) {
+      swapped.push_back(page);
+    }
+  }
+  if (swapped.empty()) {
+    return;
+  }
+
+  for (int depth = 0; depth < TABLES_DEPTH; ++depth) {
+    state.protected_frames[path[depth]]++;
+  }
+
+  // the free frames are protected, the scan skips them
+  std::vector<uint64_t> frames;
+  FrameScan scan;
+  ScanUsedFramesForEvict(0, scan);
+  for (uint64_t f = 1; f < state.num_frames && frames.size() < swapped.size(); ++f) {
+    if (IsFrameProtected(state, f)) {
+      continue;
+    }
+    if (scan.empty_tables[f]) {
+      PMwrite(scan.parent_entry[f], 0);
+      frames.push_back(f);
+    } else if (!scan.used_frames[f]) {
+      frames.push_back(f);
+    }
+  }
 
-    assert(current_frame < NUM_FRAMES);
-    assert(offset < PAGE_SIZE);
+  for (uint64_t i = 0; i < frames.size(); ++i) {
+    uint64_t level_indices[TABLES_DEPTH];
+    SplitPageIndexByLevels(swapped[i], level_indices);
+    clearFrame(frames[i]);
+    PMwrite(leaf_table * PAGE_SIZE + level_indices[TABLES_DEPTH - 1], frames[i]);
+    VM_TRACE_SCOPE(TRACE_RESTORE);
+    PMrestore(frames[i], swapped[i]);
+    state.faults++;
   }
 
-  return current_frame * PAGE_SIZE + offset;
+  for (int depth = 0; depth < TABLES_DEPTH; ++depth) {
+    state.protected_frames[path[depth]]--;
+  }
+}
+
+// copies frame 'from' into the unused frame 'to' and points its parent there
+void MoveFrame(const FrameScan& scan, uint64_t from, uint64_t to) {
+  for (uint64_t offset = 0; offset < PAGE_SIZE; ++offset) {
+    word_t word;
+    PMread(from * PAGE_SIZE + offset, &word);
+    PMwrite(to * PAGE_SIZE + offset, word);
+  }
+  PMwrite(scan.parent_entry[from], to);
+}
+
+// exchanges the contents of frames a and b through a one-page buffer and
+// repoints both parents. one of them may hold the other's parent entry.
+void SwapFrames(const FrameScan& scan, uint64_t a, uint64_t b) {
+  std::vector<word_t> temp(PAGE_SIZE);
+  for (uint64_t offset = 0; offset < PAGE_SIZE; ++offset) {
+    PMread(a * PAGE_SIZE + offset, &temp[offset]);
+  }
+  for (uint64_t offset = 0; offset < PAGE_SIZE; ++offset) {
+    word_t word;
+    PMread(b * PAGE_SIZE + offset, &word);
+    PMwrite(a * PAGE_SIZE + offset, word);
+  }
+  for (uint64_t offset = 0; offset < PAGE_SIZE; ++offset) {
+    PMwrite(b * PAGE_SIZE + offset, temp[offset]);
+  }
+
+  // an entry inside a or b moved along with its frame
+  auto moved = [&](uint64_t entry) -> uint64_t {
+    if (entry / PAGE_SIZE == a) return b * PAGE_SIZE + entry % PAGE_SIZE;
+    if (entry / PAGE_SIZE == b) return a * PAGE_SIZE + entry % PAGE_SIZE;
+    return entry;
+  };
+  PMwrite(moved(scan.parent_entry[a]), b);
+  PMwrite(moved(scan.parent_entry[b]), a);
+}
+
+// one compaction step. the highest table goes to the lowest frame below it
+// that is unused or holds a page. the page moves up into an unused frame
+// first, or trades places with the table when the RAM is full. once the
+// tables are packed, the highest page goes to the lowest unused frame below
+// it. protected and pinned frames stay where they are. returns false if
+// there was nothing to move.
+bool CompactStep(VMState& state) {
+  FrameScan scan;
+  ScanUsedFramesForEvict(0, scan);
+
+  auto movable = [&](uint64_t f) {
+    return scan.used_frames[f] && !IsFrameProtected(state, f);
+  };
+  auto unused = [&](uint64_t f) {
+    return !scan.used_frames[f] && !IsFrameProtected(state, f);
+  };
+
+  uint64_t lowest_unused = 0;
+  for (uint64_t f = 1; f < state.num_frames && lowest_unused == 0; ++f) {
+    if (unused(f)) {
+      lowest_unused = f;
+    }
+  }
+
+  uint64_t table = 0;
+  for (uint64_t f = state.num_frames - 1; f > 0 && table == 0; --f) {
+    if (movable(f) && !scan.leaf_frames[f]) {
+      table = f;
+    }
+  }
+  for (uint64_t f = 1; f < table; ++f) {
+    if (unused(f)) {
+      MoveFrame(scan, table, f);
+      return true;
+    }
+    if (movable(f) && scan.leaf_frames[f]) {
+      if (lowest_unused == 0) {
+        SwapFrames(scan, table, f);
+        return true;
+      }
+      // lowest_unused is above f, everything below f is a table or protected
+      MoveFrame(scan, f, lowest_unused);
+      MoveFrame(scan, table, f);
+      return true;
+    }
+  }
+
+  if (lowest_unused == 0) {
+    return false;
+  }
+  for (uint64_t f = state.num_frames - 1; f > lowest_unused; --f) {
+    if (movable(f)) {
+      MoveFrame(scan, f, lowest_unused);
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t ResolveAddress(uint64_t virtualAddress, VMState& state, bool allocate_if_missing) {
+  VM_TRACE_SCOPE(TRACE_ACCESS);
+  uint64_t page_index, offset;
+  SplitOffsetPage(virtualAddress, &page_index, &offset);
+  assert(offset < PAGE_SIZE);
+
+  bool faulted;
+  uint64_t frame = MapPage(page_index, state, &faulted, allocate_if_missing);
+  if (frame == 0) {
+    return UINT64_MAX;
+  }
+  AdviceRange* range = FindAdvice(state, page_index);
+  bool sequential = range != nullptr && range->advice == VM_ADVICE_SEQUENTIAL;
+  if (faulted && sequential) {
+    RestoreCluster(page_index, state);
+  }
+  if (faulted && state.compact_interval > 0 &&
+      ++state.faults_since_compact >= state.compact_interval) {
+    // the page itself has to stay put, its tables may move
+    state.faults_since_compact = 0;
+    state.protected_frames[frame]++;
+    CompactStep(state);
+    state.protected_frames[frame]--;
+  }
+
+  if (sequential) {
+    if (faulted) {
+      // read-ahead must not push out the page it was triggered by
+      state.protected_frames[frame]++;
+      ReadAhead(*range, page_index, state);
+      state.protected_frames[frame]--;
+    }
+    range->cursor = page_index;
+  }
+
+  return frame * PAGE_SIZE + offset;
+}
+
+void VMsetScanThreads(unsigned threads) {
+  std::lock_guard<std::mutex> lock(Instance().mutex);
+  CurrentVMState().scan_threads = threads;
 }
 
 int VMread(uint64_t virtualAddress, word_t* value){
   assert(virtualAddress < VIRTUAL_MEMORY_SIZE);
-  static VMState state;
-  uint64_t phys_addr = ResolveAddress(virtualAddress, state);
+  std::lock_guard<std::mutex> lock(Instance().mutex);
+  // reading doesn't map anything, only the first VMwrite does
+  uint64_t phys_addr = ResolveAddress(virtualAddress, CurrentVMState(), false);
   if (phys_addr == UINT64_MAX) return 0;
+  if (phys_addr >= RAM_SIZE) {
+    *value = zero_frame[phys_addr % PAGE_SIZE];
+    return 1;
+  }
   PMread(phys_addr, value);
-  printf ("vm read physical address: %llu ", phys_addr);
-  printf ("vm read value: %d \n", *value);
   return 1;
 }
 
 int VMwrite(uint64_t virtualAddress, word_t value){
   assert(virtualAddress < VIRTUAL_MEMORY_SIZE);
-  static VMState state;
-  uint64_t phys_addr = ResolveAddress(virtualAddress, state);
+  std::lock_guard<std::mutex> lock(Instance().mutex);
+  uint64_t phys_addr = ResolveAddress(virtualAddress, CurrentVMState(), true);
   if (phys_addr == UINT64_MAX) return 0;
   PMwrite(phys_addr, value);
-  printf ("vm write physical address: %llu ", phys_addr);
-  printf ("vm write value: %d \n", value);
   return 1;
-}
\ No newline at end of file
+}
+
+bool PinPage(uint64_t page_index) {
+  VMState& state = CurrentVMState();
+  bool faulted;
+  if (MapPage(page_index, state, &faulted, true) == 0) {
+    return false;
+  }
+
+  uint64_t path[TABLES_DEPTH];
+  bool resident = WalkPath(page_index, path);
+  assert(resident);
+
+  uint64_t newly_pinned = 0;
+  for (int depth = 0; depth < TABLES_DEPTH; ++depth) {
+    if (state.pinned_frames[path[depth]] == 0) {
+      newly_pinned++;
+    }
+  }
+  if (state.pinned_count + newly_pinned > MAX_PINNED_FRAMES(state)) {
+    return false;
+  }
+
+  for (int depth = 0; depth < TABLES_DEPTH; ++depth) {
+    state.pinned_frames[path[depth]]++;
+  }
+  state.pinned_count += newly_pinned;
+  return true;
+}
+
+bool IsPagePinned(uint64_t page_index) {
+  uint64_t path[TABLES_DEPTH];
+  return WalkPath(page_index, path) && CurrentVMState().pinned_frames[path[TABLES_DEPTH - 1]] > 0;
+}
+
+void UnpinPage(uint64_t page_index) {
+  VMState& state = CurrentVMState();
+  uint64_t path[TABLES_DEPTH];
+  bool resident = WalkPath(page_index, path);
+  assert(resident);
+
+  for (int depth = 0; depth < TABLES_DEPTH; ++depth) {
+    if (--state.pinned_frames[path[depth]] == 0) {
+      state.pinned_count--;
+    }
+  }
+}
+
+int VMpin(uint64_t virtualAddress, uint64_t length) {
+  assert(virtualAddress + length <= VIRTUAL_MEMORY_SIZE);
+  std::lock_guard<std::mutex> lock(Instance().mutex);
+  if (length == 0) return 1;
+
+  uint64_t first_page = virtualAddress >> OFFSET_WIDTH;
+  uint64_t last_page = (virtualAddress + length - 1) >> OFFSET_WIDTH;
+  for (uint64_t page = first_page; page <= last_page; ++page) {
+    if (!PinPage(page)) {
+      // over the cap, drop what this call pinned so far
+      for (uint64_t pinned = first_page; pinned < page; ++pinned) {
+        UnpinPage(pinned);
+      }
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int VMunpin(uint64_t virtualAddress, uint64_t length) {
+  assert(virtualAddress + length <= VIRTUAL_MEMORY_SIZE);
+  std::lock_guard<std::mutex> lock(Instance().mutex);
+  if (length == 0) return 1;
+
+  uint64_t first_page = virtualAddress >> OFFSET_WIDTH;
+  uint64_t last_page = (virtualAddress + length - 1) >> OFFSET_WIDTH;
+  for (uint64_t page = first_page; page <= last_page; ++page) {
+    if (!IsPagePinned(page)) return 0;
+  }
+  for (uint64_t page = first_page; page <= last_page; ++page) {
+    UnpinPage(page);
+  }
+  return 1;
+}
+
+// unmaps page_index without writing it out, and forgets its swapped out copy
+void DropPage(uint64_t page_index) {
+  uint64_t path[TABLES_DEPTH];
+  if (WalkPath(page_index, path)) {
+    uint64_t level_indices[TABLES_DEPTH];
+    SplitPageIndexByLevels(page_index, level_indices);
+    uint64_t parent = TABLES_DEPTH > 1 ? path[TABLES_DEPTH - 2] : 0;
+    PMwrite(parent * PAGE_SIZE + level_indices[TABLES_DEPTH - 1], 0);
+  }
+  PMdiscard(page_index);
+}
+
+// the overlapped part of an earlier range is cut out, whatever is left of it
+// on either side keeps its advice
+void SetRangeAdvice(uint64_t first_page, uint64_t last_page, VMAdvice advice) {
+  auto& ranges = CurrentVMState().advice_ranges;
+  std::vector<AdviceRange> kept;
+  for (const AdviceRange& range : ranges) {
+    if (range.last_page < first_page || last_page < range.first_page) {
+      kept.push_back(range);
+      continue;
+    }
+    if (range.first_page < first_page) {
+      kept.push_back({range.first_page, first_page - 1, range.advice,
+                      std::min(range.cursor, first_page)});
+    }
+    if (last_page < range.last_page) {
+      kept.push_back({last_page + 1, range.last_page, range.advice,
+                      std::max(range.cursor, last_page + 1)});
+    }
+  }
+  ranges.swap(kept);
+
+  if (advice != VM_ADVICE_NORMAL) {
+    ranges.push_back({first_page, last_page, advice, first_page});
+  }
+}
+
+int VMadvise(uint64_t virtualAddress, uint64_t length, VMAdvice advice) {
+  assert(virtualAddress + length <= VIRTUAL_MEMORY_SIZE);
+  std::lock_guard<std::mutex> lock(Instance().mutex);
+  if (length == 0) return 1;
+
+  uint64_t first_page = virtualAddress >> OFFSET_WIDTH;
+  uint64_t last_page = (virtualAddress + length - 1) >> OFFSET_WIDTH;
+
+  switch (advice) {
+    case VM_ADVICE_NORMAL:
+    case VM_ADVICE_SEQUENTIAL:
+    case VM_ADVICE_RANDOM:
+      SetRangeAdvice(first_page, last_page, advice);
+      return 1;
+
+    case VM_ADVICE_WILLNEED:
+      for (uint64_t page = first_page; page <= last_page; ++page) {
+        bool faulted;
+        if (MapPage(page, CurrentVMState(), &faulted, true) == 0) return 0;
+      }
+      return 1;
+
+    case VM_ADVICE_DONTNEED:
+      for (uint64_t page = first_page; page <= last_page; ++page) {
+        if (IsPagePinned(page)) return 0;
+      }
+      for (uint64_t page = first_page; page <= last_page; ++page) {
+        DropPage(page);
+      }
+      return 1;
+  }
+  return 0;
+}
+
+int VMsetWatermarks(uint64_t low, uint64_t high) {
+  std::lock_guard<std::mutex> lock(Instance().mutex);
+  VMState& state = CurrentVMState();
+  if (low > high || high > state.num_frames / 2) return 0;
+  state.low_watermark = low;
+  state.high_watermark = high;
+  return 1;
+}
+
+uint64_t VMcompact(uint64_t steps) {
+  std::lock_guard<std::mutex> lock(Instance().mutex);
+  uint64_t moved = 0;
+  while (moved < steps && CompactStep(CurrentVMState())) {
+    moved++;
+  }
+  return moved;
+}
+
+void VMsetCompactionInterval(uint64_t faults) {
+  std::lock_guard<std::mutex> lock(Instance().mutex);
+  CurrentVMState().compact_interval = faults;
+  CurrentVMState().faults_since_compact = 0;
+}
+
+void ReclaimerLoop(VMInstance* instance) {
+  VMsetInstance(instance);
+  Reclaimer& reclaimer = instance->reclaimer;
+  std::unique_lock<std::mutex> lock(instance->mutex);
+  for (;;) {
+    reclaimer.cv.wait(lock, [&] { return reclaimer.stopping || reclaimer.requested; });
+    if (reclaimer.stopping) {
+      return;
+    }
+    reclaimer.requested = false;
+    ReclaimFrames(instance->state.last_fault_page, instance->state);
+  }
+}
+
+void VMstartReclaimer() {
+  VMInstance& instance = Instance();
+  std::lock_guard<std::mutex> lock(instance.mutex);
+  if (instance.reclaimer.thread.joinable()) return;
+  instance.reclaimer.stopping = false;
+  instance.reclaimer.requested = instance.state.free_frames.size() < instance.state.low_watermark;
+  instance.reclaimer.thread = std::thread(ReclaimerLoop, &instance);
+}
+
+void StopReclaimer(VMInstance& instance) {
+  {
+    std::lock_guard<std::mutex> lock(instance.mutex);
+    if (!instance.reclaimer.thread.joinable()) return;
+    instance.reclaimer.stopping = true;
+  }
+  instance.reclaimer.cv.notify_one();
+  instance.reclaimer.thread.join();
+}
+
+void VMstopReclaimer() {
+  StopReclaimer(Instance());
+}
+
+VMInstance::~VMInstance() {
+  StopReclaimer(*this);
+}
+
+VMInstance* VMcreateInstance(uint64_t numFrames) {
+  assert(numFrames >= 2 * (TABLES_DEPTH + 1) && numFrames <= NUM_FRAMES);
+  VMInstance* instance = new VMInstance;
+  instance->state.num_frames = numFrames;
+  instance->pm = PMcreateInstance(numFrames);
+  return instance;
+}
+
+void VMdestroyInstance(VMInstance* instance) {
+  assert(instance != bound_instance);
+  PMInstance* pm = instance->pm;
+  delete instance;
+  PMdestroyInstance(pm);
+}
+
+void VMsetInstance(VMInstance* instance) {
+  bound_instance = instance;
+  PMsetInstance(instance != nullptr ? instance->pm : nullptr);
+}
+
+uint64_t VMfaultCount() {
+  std::lock_guard<std::mutex> lock(Instance().mutex);
+  return CurrentVMState().faults;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "MemoryConstants.h"
+#include "VirtualMemory.h"
+#include <vector>
+
+/*
+ * page-table helpers shared by the blocking VM (VirtualMemory.cpp) and the
+ * asynchronous one (AsyncVirtualMemory.cpp). not part of the public API.
+ */
+
+/*
+ * the shared, read-only zero page. reads of pages that were never written
+ * resolve to it instead of getting a frame of their own.
+ */
+#define ZERO_FRAME NUM_FRAMES
+extern const word_t zero_frame[PAGE_SIZE];
+
+/*
+ * a SEQUENTIAL or RANDOM range given to VMadvise, in pages
+ */
+struct AdviceRange {
+  uint64_t first_page;
+  uint64_t last_page;
+  VMAdvice advice;
+  // last page accessed in the range
+  uint64_t cursor;
+};
+
+struct VMState {
+  // frames this instance may use, see VMcreateInstance
+  uint64_t num_frames = NUM_FRAMES;
+  // 0 = one per core, see VMsetScanThreads
+  unsigned scan_threads = 0;
+  // frames on the path of an access in progress. counted, since async
+  // faults can share a path
+  uint32_t protected_frames[NUM_FRAMES] = {0};
+  // VMpin references: every pinned page counts once on each frame of its path
+  uint32_t pinned_frames[NUM_FRAMES] = {0};
+  // number of frames with a non-zero pinned_frames entry
+  uint64_t pinned_count = 0;
+  std::vector<AdviceRange> advice_ranges;
+  // frames freed ahead of demand by ReclaimFrames. they count in
+  // protected_frames while they sit here, so nothing else hands them out
+  std::vector<uint64_t> free_frames;
+  uint64_t low_watermark = 0;
+  uint64_t high_watermark = 0;
+  // eviction distances of the background reclaimer are measured from here
+  uint64_t last_fault_page = 0;
+  // one CompactStep every compact_interval faults, 0 = never
+  uint64_t compact_interval = 0;
+  uint64_t faults_since_compact = 0;
+  // pages brought into a frame, on demand or ahead of time, for VMfaultCount
+  uint64_t faults = 0;
+};
+
+/*
+ * the state of the VM instance the calling thread works on, see VMsetInstance
+ */
+VMState& CurrentVMState();
+
+/*
+ * everything a single walk over the table tree learns about the frames.
+ * sized at runtime, a big RAM doesn't fit on the stack.
+ */
+struct FrameScan {
+  std::vector<bool> used_frames = std::vector<bool>(NUM_FRAMES);
+  std::vector<bool> leaf_frames = std::vector<bool>(NUM_FRAMES);
+  // tables without a single non-zero entry
+  std::vector<bool> empty_tables = std::vector<bool>(NUM_FRAMES);
+  std::vector<uint64_t> page_per_frame = std::vector<uint64_t>(NUM_FRAMES);
+  // physical address of the table entry that points at the frame
+  std::vector<uint64_t> parent_entry = std::vector<uint64_t>(NUM_FRAMES);
+  uint64_t max_frame = 0;
+};
+
+/*
+ * the frame picked by ChooseFrame. if 'evict' is set the frame still holds
+ * 'evicted_page', which has to be written to swap before the frame is reused.
+ */
+struct FrameChoice {
+  uint64_t frame;
+  bool evict;
+  uint64_t evicted_page;
+};
+
+void SplitOffsetPage(uint64_t virtualAddress, uint64_t* pageIndex, uint64_t* offset);
+
+void SplitPageIndexByLevels(uint64_t pageIndex, uint64_t levelIndices[TABLES_DEPTH]);
+
+void clearFrame(uint64_t frame);
+
+void ScanUsedFramesForEvict(uint64_t root_frame, FrameScan& scan);
+
+/*
+ * the advice range covering page_index, or nullptr
+ */
+AdviceRange* FindAdvice(VMState& state, uint64_t page_index);
+
+/*
+ * same result as the sequential scan, but root subtrees are walked by a
+ * work-stealing pool of 'threads' threads (the caller being one of them).
+ */
+void ParallelScanUsedFrames(uint64_t root_frame, FrameScan& scan, unsigned threads);
+
+/*
+ * picks a frame for a new table or page and unlinks it from its current
+ * parent. protected and pinned frames are never picked; frame 0 if that
+ * leaves nothing to pick.
+ */
+FrameChoice ChooseFrame(uint64_t page_to_swap_in, const VMState& state);
+
+/*
+ * pops a frame off state.free_frames. the frame still has to be cleared.
+ */
+bool TakeFreeFrame(VMState& state, uint64_t* frame);
@@ -1,77 +1,504 @@
 #include "PhysicalMemory.h"
 #include <vector>
-#include <unordered_map>
+#include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <string>
+#include <cstdio>
 
 
 typedef std::vector<word_t> page_t;
 
-int evict_counter = 0;
+// in-memory swap. pages live in fixed PAGE_SIZE slots carved out of one slab.
+// the slab is handed out in clusters of SWAP_CLUSTER_PAGES slots, one cluster
+// per run of neighbouring virtual pages, so page p always sits in slot
+// p % SWAP_CLUSTER_PAGES of its cluster no matter when it was evicted. free
+// clusters are kept in a ring sized to the slab and clusters are found
+// through an open-addressing cluster -> slot index. once the slab has grown
+// to the working set, evict / restore don't allocate anything.
+class SwapStore {
+public:
+    bool contains(uint64_t page) const {
+        if (index.empty())
+            return false;
+        const Entry& entry = index[find(clusterOf(page))];
+        return entry.cluster == clusterOf(page) && (entry.pages & bitOf(page));
+    }
+
+    // returns the slot the page went to
+    uint64_t store(uint64_t page, const word_t* data) {
+        assert(!contains(page));
+        uint64_t cluster = clusterOf(page);
+        if (index.empty() || index[find(cluster)].cluster != cluster) {
+            if (freeCount == 0)
+                growSlab();
+            if ((used + 1) * 2 > index.size())
+                growIndex();
+            index[find(cluster)] = {cluster, popFreeCluster(), 0};
+            used++;
+        }
+        // the read buffer holds the old contents of this cluster
+        if (bufferedCluster == cluster)
+            bufferedCluster = EMPTY;
+
+        Entry& entry = index[find(cluster)];
+        uint64_t slot = entry.firstSlot + page % SWAP_CLUSTER_PAGES;
+        std::copy(data, data + PAGE_SIZE, slab.begin() + slot * PAGE_SIZE);
+        entry.pages |= bitOf(page);
+        return slot;
+    }
+
+    // copies the page out and frees its slot. false if it was never stored.
+    // the whole cluster is read in one go and kept in a buffer, 'clusterRead'
+    // tells whether this load had to go to the slab or was served from there.
+    bool load(uint64_t page, word_t* data, uint64_t* loadedSlot, bool* clusterRead) {
+        if (!contains(page))
+            return false;
+
+        uint64_t cluster = clusterOf(page);
+        const Entry& entry = index[find(cluster)];
+        *loadedSlot = entry.firstSlot + page % SWAP_CLUSTER_PAGES;
+        *clusterRead = bufferedCluster != cluster;
+        if (*clusterRead) {
+            auto first = slab.begin() + entry.firstSlot * PAGE_SIZE;
+            std::copy(first, first + SWAP_CLUSTER_PAGES * PAGE_SIZE, buffer.begin());
+            bufferedCluster = cluster;
+        }
+
+        auto buffered = buffer.begin() + (page % SWAP_CLUSTER_PAGES) * PAGE_SIZE;
+        std::copy(buffered, buffered + PAGE_SIZE, data);
+        drop(page);
+        return true;
+    }
+
+    void drop(uint64_t page) {
+        if (!contains(page))
+            return;
+
+        uint64_t i = find(clusterOf(page));
+        index[i].pages &= ~bitOf(page);
+        if (index[i].pages == 0) {
+            pushFreeCluster(index[i].firstSlot);
+            erase(i);
+            used--;
+        }
+    }
+
+private:
+    static const uint64_t EMPTY = UINT64_MAX;
+
+    struct Entry {
+        uint64_t cluster;
+        uint64_t firstSlot;
+        // one bit per page of the cluster that is in swap
+        uint64_t pages;
+    };
+
+    static uint64_t clusterOf(uint64_t page) {
+        return page / SWAP_CLUSTER_PAGES;
+    }
+
+    static uint64_t bitOf(uint64_t page) {
+        return 1ULL << (page % SWAP_CLUSTER_PAGES);
+    }
+
+    uint64_t hash(uint64_t cluster) const {
+        return (cluster * 0x9E3779B97F4A7C15ULL) & (index.size() - 1);
+    }
+
+    // the entry holding 'cluster', or the empty one where it would go
+    uint64_t find(uint64_t cluster) const {
+        uint64_t i = hash(cluster);
+        while (index[i].cluster != cluster && index[i].cluster != EMPTY)
+            i = (i + 1) & (index.size() - 1);
+        return i;
+    }
+
+    // backward-shift deletion, so lookups never need tombstones
+    void erase(uint64_t hole) {
+        uint64_t mask = index.size() - 1;
+        index[hole].cluster = EMPTY;
+        for (uint64_t i = (hole + 1) & mask; index[i].cluster != EMPTY; i = (i + 1) & mask) {
+            uint64_t home = hash(index[i].cluster);
+            // move the entry back unless its home lies in (hole, i]
+            if (((i - home) & mask) >= ((i - hole) & mask)) {
+                index[hole] = index[i];
+                index[i].cluster = EMPTY;
+                hole = i;
+            }
+        }
+    }
+
+    uint64_t popFreeCluster() {
+        uint64_t firstSlot = freeClusters[freeHead];
+        freeHead = (freeHead + 1) % freeClusters.size();
+        freeCount--;
+        return firstSlot;
+    }
+
+    // never overflows, there are only as many free clusters as the slab has
+    void pushFreeCluster(uint64_t firstSlot) {
+        freeClusters[(freeHead + freeCount) % freeClusters.size()] = firstSlot;
+        freeCount++;
+    }
+
+    void growSlab() {
+        uint64_t clusters = slab.size() / (SWAP_CLUSTER_PAGES * PAGE_SIZE);
+        uint64_t grown = std::max<uint64_t>(NUM_FRAMES / SWAP_CLUSTER_PAGES + 1, clusters * 2);
+        slab.resize(grown * SWAP_CLUSTER_PAGES * PAGE_SIZE);
+
+        // the ring grows with the slab, the free clusters keep their order
+        std::vector<uint64_t> ring(grown);
+        for (uint64_t i = 0; i < freeCount; i++)
+            ring[i] = freeClusters[(freeHead + i) % freeClusters.size()];
+        ring.swap(freeClusters);
+        freeHead = 0;
+        for (uint64_t cluster = clusters; cluster < grown; cluster++)
+            pushFreeCluster(cluster * SWAP_CLUSTER_PAGES);
+    }
+
+    void growIndex() {
+        uint64_t size = std::max<uint64_t>(2 * NUM_FRAMES / SWAP_CLUSTER_PAGES + 2, index.size() * 2);
+        // keep the size a power of two for hash / find
+        uint64_t rounded = 1;
+        while (rounded < size)
+            rounded *= 2;
+        std::vector<Entry> old(rounded, Entry{EMPTY, 0, 0});
+        old.swap(index);
+        for (const Entry& entry : old) {
+            if (entry.cluster != EMPTY)
+                index[find(entry.cluster)] = entry;
+        }
+    }
+
+    std::vector<word_t> slab;
+    // ring of the first slot of every unused cluster. handed out oldest
+    // first, so a range that was swapped in in order lands in consecutive
+    // clusters again
+    std::vector<uint64_t> freeClusters;
+    uint64_t freeHead = 0;
+    uint64_t freeCount = 0;
+    std::vector<Entry> index;
+    // clusters in the index
+    uint64_t used = 0;
+    std::vector<word_t> buffer = std::vector<word_t>(SWAP_CLUSTER_PAGES * PAGE_SIZE);
+    uint64_t bufferedCluster = EMPTY;
+};
+
+// simulated time, see PMsetCostModel
+enum CostOp { COST_RAM, COST_EVICT, COST_RESTORE, COST_SWAP_SEQUENTIAL, COST_SWAP_RANDOM, COST_OPS };
+const char* costOpNames[COST_OPS] = {
+    "ram words", "evictions", "restores", "sequential swap", "random swap"
+};
+
+struct CostPhase {
+    std::string name;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+    std::atomic<uint64_t> count[COST_OPS] = {};
+    std::atomic<uint64_t> nanos[COST_OPS] = {};
+};
+
+// everything one simulated physical memory owns, see PMcreateInstance
+struct PMInstance {
+    explicit PMInstance(uint64_t numFrames)
+        : numFrames(numFrames), RAM(numFrames, page_t(PAGE_SIZE)) {}
 
-std::vector<page_t> RAM;
-std::unordered_map<uint64_t, page_t> swapFile;
+    uint64_t numFrames;
+    std::vector<page_t> RAM;
+    int evict_counter = 0;
 
-void initialize() {
-    RAM.resize(NUM_FRAMES, page_t(PAGE_SIZE));
+    SwapStore swapFile;
+    // swap workers run PMevict / PMrestore concurrently with the caller
+    std::mutex swapMutex;
+
+    PMCostModel costModel;
+    // deque, phases are never moved once they collect counts. only changed
+    // with swapMutex held
+    std::deque<CostPhase> costPhases;
+    // the phase being charged, swap workers and the reclaimer charge it
+    // without a lock. nullptr until a model is set, nothing is counted then
+    std::atomic<CostPhase*> currentPhase{nullptr};
+    // last slot of the previous swap access, to tell sequential from random.
+    // UINT64_MAX before the first one
+    uint64_t lastSwapSlot = UINT64_MAX;
+};
+
+// a global rather than a function static: it has to outlive the default VM,
+// whose reclaimer may still be using it while statics are torn down
+PMInstance defaultInstance(NUM_FRAMES);
+thread_local PMInstance* boundInstance = nullptr;
+
+PMInstance& current() {
+    return boundInstance != nullptr ? *boundInstance : defaultInstance;
 }
 
-void PMread(uint64_t physicalAddress, word_t* value) {
+uint64_t swapLatencyMicros = 0;
+unsigned swapWorkers = 4;
+
+class SwapWorkerPool {
+public:
+    explicit SwapWorkerPool(unsigned workers) {
+        for (unsigned i = 0; i < workers; ++i)
+            threads.emplace_back([this] { work(); });
+    }
+
+    ~SwapWorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& t : threads)
+            t.join();
+    }
+
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        cv.notify_one();
+    }
+
+private:
+    void work() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
 
-    if (RAM.empty())
-        initialize();
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+};
 
-    assert(physicalAddress < RAM_SIZE);
+SwapWorkerPool& swapPool() {
+    static SwapWorkerPool pool(swapWorkers);
+    return pool;
+}
+
+void simulateSwapLatency() {
+    if (swapLatencyMicros > 0)
+        std::this_thread::sleep_for(std::chrono::microseconds(swapLatencyMicros));
+}
+
+void chargeCost(PMInstance& pm, CostOp op, uint64_t nanos) {
+    CostPhase* phase = pm.currentPhase.load(std::memory_order_acquire);
+    if (phase == nullptr)
+        return;
+    phase->count[op].fetch_add(1, std::memory_order_relaxed);
+    phase->nanos[op].fetch_add(nanos, std::memory_order_relaxed);
+}
 
-    *value = RAM[physicalAddress / PAGE_SIZE][physicalAddress
+// one access to the slots [firstSlot, firstSlot + slots). called with
+// swapMutex held. the first access has nothing to follow and is random
+void chargeSwapAccess(PMInstance& pm, uint64_t firstSlot, uint64_t slots) {
+    bool sequential = pm.lastSwapSlot != UINT64_MAX &&
+                      (firstSlot == pm.lastSwapSlot + 1 || firstSlot == pm.lastSwapSlot);
+    if (sequential)
+        chargeCost(pm, COST_SWAP_SEQUENTIAL, pm.costModel.swapSequentialNanos);
+    else
+        chargeCost(pm, COST_SWAP_RANDOM, pm.costModel.swapRandomNanos);
+    pm.lastSwapSlot = firstSlot + slots - 1;
+}
+
+void PMread(uint64_t physicalAddress, word_t* value) {
+    PMInstance& pm = current();
+
+    assert(physicalAddress < pm.numFrames * PAGE_SIZE);
+
+    *value = pm.RAM[physicalAddress / PAGE_SIZE][physicalAddress
              % PAGE_SIZE];
+    chargeCost(pm, COST_RAM, pm.costModel.ramWordNanos);
 //    std::cout << "read " << *value << " from physical address " << physicalAddress << std::endl;
  }
 
 void PMwrite(uint64_t physicalAddress, word_t value) {
 //    std::cout << "write " << value << " into physical address " << physicalAddress<< std::endl;
-    if (RAM.empty())
-        initialize();
+    PMInstance& pm = current();
 
-    assert(physicalAddress < RAM_SIZE);
+    assert(physicalAddress < pm.numFrames * PAGE_SIZE);
 
-    RAM[physicalAddress / PAGE_SIZE][physicalAddress
+    pm.RAM[physicalAddress / PAGE_SIZE][physicalAddress
              % PAGE_SIZE] = value;
+    chargeCost(pm, COST_RAM, pm.costModel.ramWordNanos);
 }
 
 void PMevict(uint64_t frameIndex, uint64_t evictedPageIndex) {
 //    std::cout << "evict " << evictedPageIndex << " from the frame " <<frameIndex<< std::endl;
-    if (RAM.empty())
-        initialize();
+    PMInstance& pm = current();
 
-    assert(swapFile.find(evictedPageIndex) == swapFile.end());
-    assert(frameIndex < NUM_FRAMES);
+    assert(frameIndex < pm.numFrames);
     assert(evictedPageIndex < NUM_PAGES);
 
-    swapFile[evictedPageIndex] = RAM[frameIndex];
-    evict_counter++;
+    simulateSwapLatency();
+
+    std::lock_guard<std::mutex> lock(pm.swapMutex);
+    uint64_t slot = pm.swapFile.store(evictedPageIndex, pm.RAM[frameIndex].data());
+    pm.evict_counter++;
+    chargeCost(pm, COST_EVICT, pm.costModel.evictNanos);
+    chargeSwapAccess(pm, slot, 1);
 }
 
 void PMrestore(uint64_t frameIndex, uint64_t restoredPageIndex) {
 //    std::cout << "restore " << restoredPageIndex << " from the hard drive to the frame " << frameIndex << std::endl;
-    if (RAM.empty())
-        initialize();
+    PMInstance& pm = current();
 
-    assert(frameIndex < NUM_FRAMES);
+    assert(frameIndex < pm.numFrames);
 
-    // page is not in swap file, so this is essentially
-    // the first reference to this page. we can just return
+    simulateSwapLatency();
+
+    std::lock_guard<std::mutex> lock(pm.swapMutex);
+    // if the page is not in the swap file this is essentially
+    // the first reference to this page. load leaves the frame alone
     // as it doesn't matter if the page contains garbage
-    if (swapFile.find(restoredPageIndex) == swapFile.end())
+    uint64_t slot;
+    bool clusterRead;
+    if (pm.swapFile.load(restoredPageIndex, pm.RAM[frameIndex].data(), &slot, &clusterRead)) {
+        chargeCost(pm, COST_RESTORE, pm.costModel.restoreNanos);
+        // the rest of the cluster comes out of the same read
+        if (clusterRead)
+            chargeSwapAccess(pm, slot - restoredPageIndex % SWAP_CLUSTER_PAGES, SWAP_CLUSTER_PAGES);
+    }
+}
+
+void PMdiscard(uint64_t pageIndex) {
+    assert(pageIndex < NUM_PAGES);
+
+    PMInstance& pm = current();
+    std::lock_guard<std::mutex> lock(pm.swapMutex);
+    pm.swapFile.drop(pageIndex);
+}
+
+bool PMisSwapped(uint64_t pageIndex) {
+    PMInstance& pm = current();
+    std::lock_guard<std::mutex> lock(pm.swapMutex);
+    return pm.swapFile.contains(pageIndex);
+}
+
+// the workers are shared by all instances, every job runs on the
+// instance of the thread that queued it
+void PMevictAsync(uint64_t frameIndex, uint64_t evictedPageIndex,
+                  std::function<void()> onDone) {
+    PMInstance* pm = &current();
+    swapPool().submit([=] {
+        PMsetInstance(pm);
+        PMevict(frameIndex, evictedPageIndex);
+        onDone();
+    });
+}
+
+void PMrestoreAsync(uint64_t frameIndex, uint64_t restoredPageIndex,
+                    std::function<void()> onDone) {
+    PMInstance* pm = &current();
+    swapPool().submit([=] {
+        PMsetInstance(pm);
+        PMrestore(frameIndex, restoredPageIndex);
+        onDone();
+    });
+}
+
+void PMsetSwapWorkers(unsigned workers) {
+    assert(workers > 0);
+    swapWorkers = workers;
+}
+
+void PMsetSwapLatency(uint64_t micros) {
+    swapLatencyMicros = micros;
+}
+
+// swapMutex held
+void beginPhase(PMInstance& pm, const char* name) {
+    auto now = std::chrono::steady_clock::now();
+    if (!pm.costPhases.empty())
+        pm.costPhases.back().end = now;
+    pm.costPhases.emplace_back();
+    pm.costPhases.back().name = name;
+    pm.costPhases.back().start = now;
+    pm.costPhases.back().end = now;
+    // the phase is complete before anybody can charge it
+    pm.currentPhase.store(&pm.costPhases.back(), std::memory_order_release);
+}
+
+void PMsetCostModel(const PMCostModel& model) {
+    PMInstance& pm = current();
+    std::lock_guard<std::mutex> lock(pm.swapMutex);
+    pm.costModel = model;
+    if (pm.costPhases.empty())
+        beginPhase(pm, "main");
+}
+
+void PMbeginPhase(const char* name) {
+    PMInstance& pm = current();
+    std::lock_guard<std::mutex> lock(pm.swapMutex);
+    beginPhase(pm, name);
+}
+
+void printCostReport() {
+    PMInstance& pm = current();
+    std::lock_guard<std::mutex> lock(pm.swapMutex);
+    if (pm.costPhases.empty())
         return;
+    pm.costPhases.back().end = std::chrono::steady_clock::now();
+
+    for (const CostPhase& phase : pm.costPhases) {
+        double wallMs = std::chrono::duration<double, std::milli>(phase.end - phase.start).count();
+        uint64_t totalNanos = 0;
+        for (int op = 0; op < COST_OPS; op++)
+            totalNanos += phase.nanos[op];
 
-    RAM[frameIndex] = std::move(swapFile[restoredPageIndex]);
-    swapFile.erase(restoredPageIndex);
+        printf("phase %s: simulated %.3f ms, measured %.3f ms\n",
+               phase.name.c_str(), totalNanos / 1e6, wallMs);
+        for (int op = 0; op < COST_OPS; op++) {
+            printf("  %-16s %12llu  %12.3f ms\n", costOpNames[op],
+                   (long long unsigned) phase.count[op], phase.nanos[op] / 1e6);
+        }
+    }
+}
+
+PMInstance* PMcreateInstance(uint64_t numFrames) {
+    assert(numFrames > 0 && numFrames <= NUM_FRAMES);
+    return new PMInstance(numFrames);
+}
+
+void PMdestroyInstance(PMInstance* instance) {
+    assert(instance != &defaultInstance && instance != boundInstance);
+    delete instance;
+}
+
+void PMsetInstance(PMInstance* instance) {
+    boundInstance = instance;
+}
+
+PMInstance* PMgetInstance() {
+    return &current();
+}
+
+uint64_t PMevictionCount() {
+    return current().evict_counter;
 }
 
 void printRam()
 {
-    for (uint64_t  i = 0; i < RAM_SIZE; i++)
+    for (uint64_t  i = 0; i < current().numFrames * PAGE_SIZE; i++)
     {
         word_t tmp;
         PMread(i, &tmp);
@@ -83,6 +510,5 @@ void printRam()
 
 void printEvictionCounter()
 {
-    std::cout << evict_counter << std::endl;
+    std::cout << current().evict_counter << std::endl;
 }
-
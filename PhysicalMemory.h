@@ -1,6 +1,14 @@
 #pragma once
 
 #include "MemoryConstants.h"
+#include <functional>
+
+/*
+ * the swap file is laid out in clusters of this many neighbouring pages:
+ * pages p and p + 1 of one cluster always sit in neighbouring slots, and a
+ * PMrestore reads in the whole cluster at once.
+ */
+#define SWAP_CLUSTER_PAGES (PAGE_SIZE < 8 ? PAGE_SIZE : 8)
 
 /*
  * reads an integer from the given physical address and puts it in 'value'
@@ -24,6 +32,105 @@ void PMevict(uint64_t frameIndex, uint64_t evictedPageIndex);
  */
 void PMrestore(uint64_t frameIndex, uint64_t restoredPageIndex);
 
+/*
+ * drops the swapped out copy of a page, if there is one. a later PMrestore
+ * of the page leaves the frame as it is, like for a page never evicted.
+ */
+void PMdiscard(uint64_t pageIndex);
+
+/*
+ * whether the page has a copy in the swap file
+ */
+bool PMisSwapped(uint64_t pageIndex);
+
+/*
+ * asynchronous PMevict / PMrestore. the copy is queued to a pool of swap
+ * worker threads and 'onDone' is called on the worker once it has finished.
+ * the frame must not be touched by the caller until then.
+ */
+void PMevictAsync(uint64_t frameIndex, uint64_t evictedPageIndex,
+                  std::function<void()> onDone);
+
+void PMrestoreAsync(uint64_t frameIndex, uint64_t restoredPageIndex,
+                    std::function<void()> onDone);
+
+/*
+ * number of swap worker threads behind the async calls.
+ * only takes effect before the first async call.
+ */
+void PMsetSwapWorkers(unsigned workers);
+
+/*
+ * simulated latency of a single swap operation (sync or async), in microseconds.
+ */
+void PMsetSwapLatency(uint64_t micros);
+
+/*
+ * simulated latencies in nanoseconds. a swap access is sequential when it
+ * touches the swap slot right after the previous one, random otherwise.
+ * evictions and restores pay their own cost plus one swap access, except
+ * restores served from the cluster read of an earlier one.
+ */
+struct PMCostModel {
+    uint64_t ramWordNanos = 10;
+    uint64_t evictNanos = 1000;
+    uint64_t restoreNanos = 1000;
+    uint64_t swapSequentialNanos = 20000;
+    uint64_t swapRandomNanos = 100000;
+};
+
+/*
+ * turns on simulated-time accounting with the given costs. nothing is
+ * counted before the first call. the costs are read without a lock, so
+ * change them only while no async swap I/O or reclaimer is running.
+ */
+void PMsetCostModel(const PMCostModel& model);
+
+/*
+ * starts a new accounting phase, e.g. "warmup" then "measure". the first
+ * phase is called "main". safe while async swap I/O is in flight, what it
+ * charges goes to whichever phase is current at that moment.
+ */
+void PMbeginPhase(const char* name);
+
+/*
+ * print the simulated time per operation and per phase, next to the
+ * measured wall time of each phase.
+ */
+void printCostReport();
+
+/*
+ * a separate simulated physical memory with its own RAM of 'numFrames'
+ * frames (at most NUM_FRAMES), swap file, eviction counter and cost
+ * accounting. every PM call works on the instance set for the calling
+ * thread with PMsetInstance, or on the default one (NUM_FRAMES frames) if
+ * none was set, so independent simulations can run on separate threads.
+ */
+struct PMInstance;
+
+PMInstance* PMcreateInstance(uint64_t numFrames);
+
+/*
+ * the instance must not be in use by any thread anymore
+ */
+void PMdestroyInstance(PMInstance* instance);
+
+/*
+ * sets the instance for the calling thread, nullptr goes back to the
+ * default one
+ */
+void PMsetInstance(PMInstance* instance);
+
+/*
+ * the instance the calling thread works on
+ */
+PMInstance* PMgetInstance();
+
+/*
+ * number of PMevict calls on the current instance so far
+ */
+uint64_t PMevictionCount();
+
 /*
  * print the current state of the ram.
  */
@@ -25,5 +25,144 @@ int VMread(uint64_t virtualAddress, word_t* value);
 
 int VMwrite(uint64_t virtualAddress, word_t value);
 
+/*
+ * number of threads used for whole page-table scans (victim selection).
+ * 0 (the default) uses one per core, but only once the RAM is large enough
+ * for it to pay off; any other value is used as is.
+ */
+void VMsetScanThreads(unsigned threads);
+
+/*
+ * pins the pages covering [virtualAddress, virtualAddress + length), along
+ * with the tables above them, so they stay in RAM until unpinned. pages are
+ * brought in first if needed. pins are reference counted per page.
+ *
+ * returns 1 on success.
+ * returns 0 if that would pin more frames than allowed; nothing is pinned then.
+ */
+int VMpin(uint64_t virtualAddress, uint64_t length);
+
+/*
+ * drops one pin from every page covering [virtualAddress, virtualAddress + length).
+ *
+ * returns 1 on success.
+ * returns 0 if one of the pages isn't pinned; nothing is unpinned then.
+ */
+int VMunpin(uint64_t virtualAddress, uint64_t length);
 
+/*
+ * access-pattern hints for VMadvise
+ */
+enum VMAdvice {
+    // forget earlier SEQUENTIAL / RANDOM advice for the range
+    VM_ADVICE_NORMAL,
+    // read ahead on faults, and evict pages behind the last access first
+    VM_ADVICE_SEQUENTIAL,
+    // no read-ahead
+    VM_ADVICE_RANDOM,
+    // bring the pages in now
+    VM_ADVICE_WILLNEED,
+    // drop the pages and their swapped out copies. they read back as 0
+    VM_ADVICE_DONTNEED
+};
+
+/*
+ * tells the VM how [virtualAddress, virtualAddress + length) is going to be
+ * used. SEQUENTIAL, RANDOM and NORMAL replace any earlier advice for the
+ * pages in the range; earlier advice outside of it stays.
+ *
+ * returns 1 on success.
+ * returns 0 on failure: DONTNEED on a range with pinned pages, or WILLNEED
+ * for a page that can't get a frame (the pages before it stay in)
+ */
+int VMadvise(uint64_t virtualAddress, uint64_t length, VMAdvice advice);
+
+/*
+ * free-frame watermarks. once fewer than 'low' frames are free, a single
+ * scan frees a batch of frames (evicting pages if it has to) until 'high'
+ * frames are free. 0, 0 (the default) frees one frame per fault.
+ *
+ * returns 1 on success.
+ * returns 0 if low > high or high is more than half of the frames.
+ */
+int VMsetWatermarks(uint64_t low, uint64_t high);
+
+/*
+ * moves frames around so the page tables sit at the low end of the RAM,
+ * the pages above them and the unused frames at the top. runs at most
+ * 'steps' steps of one move each, e.g. while the caller is idle.
+ *
+ * returns the number of steps that moved something, less than 'steps'
+ * once everything is packed.
+ */
+uint64_t VMcompact(uint64_t steps);
+
+/*
+ * runs one VMcompact step every 'faults' page faults. 0 (the default)
+ * turns it off.
+ */
+void VMsetCompactionInterval(uint64_t faults);
 
+/*
+ * starts / stops a background thread that refills the free frames ahead of
+ * demand, instead of the faulting access. works with the blocking API only.
+ */
+void VMstartReclaimer();
+
+void VMstopReclaimer();
+
+/*
+ * a separate virtual memory on its own physical memory of 'numFrames'
+ * frames (see PMcreateInstance), with its own tables, pins, advice,
+ * watermarks and reclaimer. the page and virtual memory sizes are the ones
+ * from MemoryConstants.h; numFrames can be anything from
+ * 2 * (TABLES_DEPTH + 1) up to NUM_FRAMES.
+ */
+struct VMInstance;
+
+VMInstance* VMcreateInstance(uint64_t numFrames);
+
+/*
+ * stops the instance's reclaimer. the instance must not be in use by any
+ * thread anymore. scans finish inside the VM call that started them, so
+ * the scan threads are done with it once every call has returned.
+ */
+void VMdestroyInstance(VMInstance* instance);
+
+/*
+ * every VM call of the calling thread goes to 'instance' from now on, and
+ * every PM call to its physical memory. nullptr goes back to the default
+ * instance (NUM_FRAMES frames), which is what threads start with.
+ */
+void VMsetInstance(VMInstance* instance);
+
+/*
+ * number of pages brought into a frame so far: page faults, and the pages
+ * read-ahead, swap clusters, WILLNEED and VMpin bring in along the way
+ */
+uint64_t VMfaultCount();
+
+/*
+ * per-phase latency of accesses: walking the levels, the table search, the
+ * eviction scan and victim search, PMevict, PMrestore. only recorded when
+ * the VM is built with -DVM_TRACE; every thread keeps its last
+ * VM_TRACE_EVENTS events. call these while no other thread is inside the VM.
+ */
+
+/*
+ * writes the events as Chrome trace JSON, for chrome://tracing or Perfetto.
+ *
+ * returns 1 on success.
+ * returns 0 if the file can't be written or tracing is off.
+ */
+int VMtraceExport(const char* path);
+
+/*
+ * prints count, p50, p99 and max duration per phase
+ */
+void VMtracePrintSummary();
+
+/*
+ * forgets the events recorded so far
+ */
+void VMtraceReset();
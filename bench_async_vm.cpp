@@ -0,0 +1,74 @@
+#include "VirtualMemory.h"
+#include "AsyncVirtualMemory.h"
+#include "PhysicalMemory.h"
+
+#include <cstdio>
+#include <cassert>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// random reads over a working set four times the size of the RAM, once with
+// the blocking VMread and once with many VMreadAsync tasks in flight.
+
+const uint64_t WORKING_SET_PAGES = 4 * NUM_FRAMES;
+const uint64_t ACCESSES = 4000;
+const uint64_t TASKS = 16;
+const uint64_t SWAP_LATENCY_MICROS = 200;
+
+uint64_t PageAddress(uint64_t page) {
+    return (page % NUM_PAGES) * PAGE_SIZE;
+}
+
+std::vector<uint64_t> MakeWorkload(uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<uint64_t> pages(ACCESSES);
+    for (auto& page : pages) {
+        page = rng() % WORKING_SET_PAGES;
+    }
+    return pages;
+}
+
+VMTask<void> Reader(const std::vector<uint64_t>& pages, uint64_t first, uint64_t step) {
+    for (uint64_t i = first; i < pages.size(); i += step) {
+        word_t value;
+        co_await VMreadAsync(PageAddress(pages[i]), &value);
+        assert(uint64_t(value) == pages[i]);
+    }
+}
+
+int main(int argc, char **argv) {
+    VMinitialize();
+    for (uint64_t page = 0; page < WORKING_SET_PAGES; ++page) {
+        VMwrite(PageAddress(page), page);
+    }
+
+    PMsetSwapWorkers(TASKS);
+    PMsetSwapLatency(SWAP_LATENCY_MICROS);
+    std::vector<uint64_t> pages = MakeWorkload(1);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t page : pages) {
+        word_t value;
+        VMread(PageAddress(page), &value);
+        assert(uint64_t(value) == page);
+    }
+    double blocking = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    VMScheduler scheduler;
+    for (uint64_t t = 0; t < TASKS; ++t) {
+        scheduler.Spawn(Reader(pages, t, TASKS));
+    }
+    start = std::chrono::steady_clock::now();
+    scheduler.Run();
+    double async = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("accesses: %llu, swap latency: %llu us, tasks: %llu\n",
+           (long long unsigned) ACCESSES, (long long unsigned) SWAP_LATENCY_MICROS,
+           (long long unsigned) TASKS);
+    printf("blocking: %.0f accesses/s\n", ACCESSES / blocking);
+    printf("async:    %.0f accesses/s\n", ACCESSES / async);
+    printf("speedup:  %.2fx\n", blocking / async);
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include "VirtualMemory.h"
+#include "PhysicalMemory.h"
+
+#include <cstdio>
+#include <cassert>
+#include <chrono>
+#include <random>
+#include <thread>
+
+// average fault latency for a growing number of scan threads. every access
+// touches one of 2 * NUM_FRAMES pages, so about half of them fault once the
+// RAM is full. the interesting numbers need a large PHYSICAL_ADDRESS_WIDTH.
+// built with -DVM_TRACE it also prints the latency per fault phase, and
+// writes a Chrome trace to the file given as the first argument.
+
+const uint64_t WORKING_SET_PAGES = 2 * NUM_FRAMES < NUM_PAGES ? 2 * NUM_FRAMES : NUM_PAGES;
+const uint64_t ACCESSES = 200;
+
+int main(int argc, char **argv) {
+    VMinitialize();
+    for (uint64_t page = 0; page < WORKING_SET_PAGES; ++page) {
+        VMwrite(page * PAGE_SIZE, page);
+    }
+
+    std::mt19937_64 rng(1);
+    unsigned cores = std::thread::hardware_concurrency();
+    for (unsigned threads = 1; threads <= cores; threads *= 2) {
+        VMsetScanThreads(threads);
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < ACCESSES; ++i) {
+            uint64_t page = rng() % WORKING_SET_PAGES;
+            word_t value;
+            VMread(page * PAGE_SIZE, &value);
+            assert(uint64_t(value) == page);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        printf("frames: %llu, scan threads: %u, %.1f us per access\n",
+               (long long unsigned) NUM_FRAMES, threads, seconds * 1e6 / ACCESSES);
+    }
+
+#ifdef VM_TRACE
+    VMtracePrintSummary();
+    if (argc > 1 && !VMtraceExport(argv[1])) {
+        printf("can't write %s\n", argv[1]);
+    }
+#endif
+
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include "VirtualMemory.h"
+#include "PhysicalMemory.h"
+
+#include <cstdio>
+#include <chrono>
+#include <sys/resource.h>
+
+// evict / restore churn straight against the physical memory: every round
+// pushes SWAPPED_PAGES pages out to swap and brings them all back.
+
+const uint64_t SWAPPED_PAGES = NUM_PAGES / 4;
+const uint64_t ROUNDS = 20;
+
+long PeakRssKb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+int main(int argc, char **argv) {
+    VMinitialize();
+    long rssBefore = PeakRssKb();
+    PMsetCostModel(PMCostModel());
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t round = 0; round < ROUNDS; ++round) {
+        for (uint64_t page = 0; page < SWAPPED_PAGES; ++page) {
+            PMevict(page % NUM_FRAMES, page);
+        }
+        for (uint64_t page = 0; page < SWAPPED_PAGES; ++page) {
+            PMrestore(page % NUM_FRAMES, page);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t operations = 2 * ROUNDS * SWAPPED_PAGES;
+    printf("swapped pages: %llu, page size: %llu words\n",
+           (long long unsigned) SWAPPED_PAGES, (long long unsigned) PAGE_SIZE);
+    printf("evict + restore: %.0f ops/s\n", operations / seconds);
+    printf("peak rss: %ld KB (%ld KB before the churn)\n", PeakRssKb(), rssBefore);
+    printCostReport();
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include "VirtualMemory.h"
+#include "PhysicalMemory.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+// runs every combination of RAM size, policy and workload as its own VM
+// instance, one per core, and prints faults, evictions and time per run.
+// the page size and the virtual memory size come from MemoryConstants.h,
+// the RAM size is set per instance.
+
+const uint64_t WORKING_SET_PAGES = 4 * NUM_FRAMES < NUM_PAGES ? 4 * NUM_FRAMES : NUM_PAGES;
+const uint64_t ACCESSES = 20000;
+const uint64_t MIN_FRAMES = 2 * (TABLES_DEPTH + 1);
+
+enum Policy { POLICY_DEFAULT, POLICY_WATERMARKS, POLICY_SEQUENTIAL, POLICY_COMPACTION, POLICIES };
+const char* policyNames[POLICIES] = {"default", "watermarks", "sequential", "compaction"};
+
+enum Workload { WORKLOAD_SWEEP, WORKLOAD_RANDOM, WORKLOAD_HOT_COLD, WORKLOADS };
+const char* workloadNames[WORKLOADS] = {"sweep", "random", "hot/cold"};
+
+struct Run {
+    uint64_t frames;
+    Policy policy;
+    Workload workload;
+
+    uint64_t faults = 0;
+    uint64_t evictions = 0;
+    double millis = 0;
+    bool correct = false;
+};
+
+std::vector<uint64_t> MakePages(Workload workload) {
+    std::mt19937_64 rng(1);
+    std::vector<uint64_t> pages(ACCESSES);
+    for (uint64_t i = 0; i < ACCESSES; ++i) {
+        switch (workload) {
+            case WORKLOAD_SWEEP:
+                pages[i] = i % WORKING_SET_PAGES;
+                break;
+            case WORKLOAD_RANDOM:
+                pages[i] = rng() % WORKING_SET_PAGES;
+                break;
+            case WORKLOAD_HOT_COLD:
+                // 90% of the accesses go to the first tenth of the pages
+                pages[i] = rng() % 10 < 9 ? rng() % (WORKING_SET_PAGES / 10 + 1)
+                                          : rng() % WORKING_SET_PAGES;
+                break;
+            default:
+                break;
+        }
+    }
+    return pages;
+}
+
+void ApplyPolicy(Policy policy, uint64_t frames) {
+    switch (policy) {
+        case POLICY_WATERMARKS:
+            VMsetWatermarks(frames / 16, frames / 4);
+            break;
+        case POLICY_SEQUENTIAL:
+            VMadvise(0, WORKING_SET_PAGES * PAGE_SIZE, VM_ADVICE_SEQUENTIAL);
+            break;
+        case POLICY_COMPACTION:
+            VMsetCompactionInterval(8);
+            break;
+        default:
+            break;
+    }
+}
+
+// writes every page of the working set once, then replays the workload
+void Execute(Run& run) {
+    VMInstance* instance = VMcreateInstance(run.frames);
+    VMsetInstance(instance);
+    // the sweep already keeps every core busy
+    VMsetScanThreads(1);
+    ApplyPolicy(run.policy, run.frames);
+
+    std::vector<uint64_t> pages = MakePages(run.workload);
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t page = 0; page < WORKING_SET_PAGES; ++page) {
+        VMwrite(page * PAGE_SIZE, page);
+    }
+    run.correct = true;
+    for (uint64_t page : pages) {
+        word_t value;
+        VMread(page * PAGE_SIZE, &value);
+        run.correct = run.correct && uint64_t(value) == page;
+    }
+    run.millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    run.faults = VMfaultCount();
+    run.evictions = PMevictionCount();
+
+    VMsetInstance(nullptr);
+    VMdestroyInstance(instance);
+}
+
+int main(int argc, char **argv) {
+    std::vector<Run> runs;
+    for (uint64_t frames = NUM_FRAMES; frames >= MIN_FRAMES; frames /= 2) {
+        for (int policy = 0; policy < POLICIES; ++policy) {
+            for (int workload = 0; workload < WORKLOADS; ++workload) {
+                runs.push_back({frames, Policy(policy), Workload(workload)});
+            }
+        }
+    }
+
+    // one thread per core unless given
+    unsigned threads = argc > 1 ? atoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<uint64_t> next{0};
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            for (uint64_t i = next++; i < runs.size(); i = next++) {
+                Execute(runs[i]);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%8s  %-11s  %-9s  %9s  %9s  %10s\n",
+           "frames", "policy", "workload", "faults", "evictions", "time (ms)");
+    for (const Run& run : runs) {
+        assert(run.correct);
+        printf("%8llu  %-11s  %-9s  %9llu  %9llu  %10.2f\n",
+               (long long unsigned) run.frames, policyNames[run.policy],
+               workloadNames[run.workload], (long long unsigned) run.faults,
+               (long long unsigned) run.evictions, run.millis);
+    }
+    printf("%zu runs on %u threads in %.2f s\n", runs.size(), threads, seconds);
+
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include "VirtualMemory.h"
+#include "PhysicalMemory.h"
+
+#include <cstdio>
+#include <cassert>
+#include <vector>
+
+// written for MemoryConstants.h, the RAM of the smaller test geometries has
+// no room for a pinned path next to a fault.
+
+// pages far enough apart that each one needs its own tables
+uint64_t SpreadPage(uint64_t i) {
+    uint64_t stride = NUM_PAGES / PAGE_SIZE > 0 ? PAGE_SIZE : 1;
+    return (i * stride) % NUM_PAGES;
+}
+
+int main(int argc, char **argv) {
+    VMinitialize();
+
+    // pins are counted per page
+    assert(VMpin(0, PAGE_SIZE) == 1);
+    assert(VMpin(0, PAGE_SIZE) == 1);
+    assert(VMunpin(0, PAGE_SIZE) == 1);
+    assert(VMunpin(0, PAGE_SIZE) == 1);
+    assert(VMunpin(0, PAGE_SIZE) == 0);
+
+    // unpinning a range with an unpinned page in it changes nothing
+    assert(VMpin(0, PAGE_SIZE) == 1);
+    assert(VMunpin(0, 2 * PAGE_SIZE) == 0);
+    assert(VMunpin(0, PAGE_SIZE) == 1);
+
+    // pin until the cap is reached, a pin over the cap is rolled back whole
+    std::vector<uint64_t> pinned;
+    for (uint64_t i = 0; i < NUM_PAGES; ++i) {
+        uint64_t page = SpreadPage(i);
+        if (VMpin(page * PAGE_SIZE, PAGE_SIZE) == 0) {
+            assert(VMunpin(page * PAGE_SIZE, PAGE_SIZE) == 0);
+            break;
+        }
+        VMwrite(page * PAGE_SIZE, page + 1);
+        pinned.push_back(page);
+    }
+    assert(!pinned.empty() && pinned.size() < NUM_PAGES);
+
+    // the rest of the memory still gets frames and the pinned pages keep their data
+    for (uint64_t page = 0; page < NUM_PAGES; ++page) {
+        VMwrite(page * PAGE_SIZE + PAGE_SIZE - 1, page);
+    }
+    for (uint64_t page : pinned) {
+        word_t value;
+        VMread(page * PAGE_SIZE, &value);
+        assert(uint64_t(value) == page + 1);
+    }
+
+    for (uint64_t page : pinned) {
+        assert(VMunpin(page * PAGE_SIZE, PAGE_SIZE) == 1);
+    }
+    assert(VMunpin(pinned[0] * PAGE_SIZE, PAGE_SIZE) == 0);
+
+    printf("success\n");
+
+    return 0;
+}
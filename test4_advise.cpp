@@ -0,0 +1,69 @@
+#include "VirtualMemory.h"
+#include "PhysicalMemory.h"
+
+#include <cstdio>
+#include <cassert>
+
+// written for MemoryConstants.h, the smaller test geometries have no room
+// for read-ahead next to the tables of a fault.
+
+const uint64_t WORKING_SET_PAGES = 4 * NUM_FRAMES < NUM_PAGES ? 4 * NUM_FRAMES : NUM_PAGES;
+
+// reads pages [first, last] in order and returns how many of the reads had
+// to bring a page in. pages read ahead are brought in too, but by an earlier read
+uint64_t ReadInOrder(uint64_t first, uint64_t last) {
+    uint64_t faulting_reads = 0;
+    for (uint64_t page = first; page <= last; ++page) {
+        uint64_t faults = VMfaultCount();
+        word_t value;
+        VMread(page * PAGE_SIZE, &value);
+        assert(uint64_t(value) == page + 1);
+        if (VMfaultCount() != faults) {
+            faulting_reads++;
+        }
+    }
+    return faulting_reads;
+}
+
+int main(int argc, char **argv) {
+    VMinitialize();
+    for (uint64_t page = 0; page < WORKING_SET_PAGES; ++page) {
+        VMwrite(page * PAGE_SIZE, page + 1);
+    }
+
+    // without advice every page of a sweep over the working set faults
+    uint64_t quarter = WORKING_SET_PAGES / 4;
+    assert(ReadInOrder(0, WORKING_SET_PAGES - 1) == WORKING_SET_PAGES);
+
+    // read-ahead brings in the next pages on every fault
+    VMadvise(0, WORKING_SET_PAGES * PAGE_SIZE, VM_ADVICE_SEQUENTIAL);
+    assert(ReadInOrder(0, WORKING_SET_PAGES - 1) < WORKING_SET_PAGES / 2);
+
+    // RANDOM in the second quarter only replaces the advice there
+    VMadvise(quarter * PAGE_SIZE, quarter * PAGE_SIZE, VM_ADVICE_RANDOM);
+    assert(ReadInOrder(0, quarter - 1) < quarter / 2);
+    assert(ReadInOrder(quarter, 2 * quarter - 1) == quarter);
+    assert(ReadInOrder(2 * quarter, WORKING_SET_PAGES - 1) < quarter);
+
+    // NORMAL forgets the advice. a few read-ahead pages are still resident
+    VMadvise(0, WORKING_SET_PAGES * PAGE_SIZE, VM_ADVICE_NORMAL);
+    assert(ReadInOrder(0, WORKING_SET_PAGES - 1) > WORKING_SET_PAGES / 2);
+
+    // dropped pages read back as 0, resident or swapped out
+    assert(VMadvise(0, 2 * quarter * PAGE_SIZE, VM_ADVICE_DONTNEED) == 1);
+    for (uint64_t page = 0; page < WORKING_SET_PAGES; ++page) {
+        word_t value;
+        VMread(page * PAGE_SIZE, &value);
+        assert(uint64_t(value) == (page < 2 * quarter ? 0 : page + 1));
+    }
+
+    // and can be written again
+    VMwrite(0, 1);
+    word_t value;
+    VMread(0, &value);
+    assert(value == 1);
+
+    printf("success\n");
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include "VirtualMemory.h"
+#include "PhysicalMemory.h"
+
+#include <cstdio>
+#include <cassert>
+
+// every entry of the root table is 0
+bool RootTableEmpty() {
+    for (uint64_t i = 0; i < PAGE_SIZE; ++i) {
+        word_t entry;
+        PMread(i, &entry);
+        if (entry != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    VMinitialize();
+
+    // pages that were never written read as 0 without mapping anything
+    for (uint64_t page = 0; page < NUM_PAGES; ++page) {
+        word_t value = 1;
+        assert(VMread(page * PAGE_SIZE + page % PAGE_SIZE, &value) == 1);
+        assert(value == 0);
+    }
+    assert(RootTableEmpty());
+    assert(VMfaultCount() == 0);
+    assert(PMevictionCount() == 0);
+
+    // a write maps the page, its neighbours still read as 0
+    VMwrite(PAGE_SIZE, 7);
+    assert(!RootTableEmpty());
+    for (uint64_t page = 0; page < NUM_PAGES; ++page) {
+        word_t value;
+        VMread(page * PAGE_SIZE, &value);
+        assert(uint64_t(value) == (page == 1 ? 7 : 0));
+    }
+
+    // push page 1 out to swap with writes to the upper half
+    for (uint64_t page = NUM_PAGES / 2; page < NUM_PAGES && !PMisSwapped(1); ++page) {
+        VMwrite(page * PAGE_SIZE, 1);
+    }
+    assert(PMisSwapped(1));
+
+    // a fault inside a SEQUENTIAL range only brings in that page, read-ahead
+    // leaves the never-written pages after it unmapped
+    VMadvise(0, NUM_PAGES / 2 * PAGE_SIZE, VM_ADVICE_SEQUENTIAL);
+    uint64_t faults = VMfaultCount();
+    for (uint64_t page = 0; page < NUM_PAGES / 2; ++page) {
+        word_t value;
+        VMread(page * PAGE_SIZE, &value);
+        assert(uint64_t(value) == (page == 1 ? 7 : 0));
+    }
+    assert(VMfaultCount() - faults == 1);
+
+    printf("success\n");
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "VirtualMemory.h"
+#include "PhysicalMemory.h"
+#include "VirtualMemoryInternal.h"
+
+#include <cstdio>
+#include <cassert>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+const uint64_t WRITES = 8 * NUM_FRAMES;
+
+// value each page should read back, 0 if it was never written or dropped
+std::vector<word_t> expected(NUM_PAGES, 0);
+
+void CheckContents() {
+    for (uint64_t page = 0; page < NUM_PAGES; ++page) {
+        word_t value;
+        VMread(page * PAGE_SIZE, &value);
+        assert(value == expected[page]);
+    }
+}
+
+// tables sit below pages. with 'packed', the used frames also leave no gap
+void CheckLayout(bool packed) {
+    FrameScan scan;
+    ScanUsedFramesForEvict(0, scan);
+    uint64_t last_table = 0, first_page = NUM_FRAMES, last_used = 0, used = 0;
+    for (uint64_t f = 1; f < NUM_FRAMES; ++f) {
+        if (!scan.used_frames[f]) {
+            continue;
+        }
+        used++;
+        last_used = f;
+        if (scan.leaf_frames[f]) {
+            first_page = std::min(first_page, f);
+        } else {
+            last_table = f;
+        }
+    }
+    assert(last_table < first_page);
+    assert(!packed || last_used == used);
+}
+
+void WriteRandomPages(uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    for (uint64_t i = 0; i < WRITES; ++i) {
+        uint64_t page = rng() % NUM_PAGES;
+        VMwrite(page * PAGE_SIZE, page + 1);
+        expected[page] = page + 1;
+    }
+}
+
+int main(int argc, char **argv) {
+    VMinitialize();
+
+    // a full RAM, tables and pages can only trade places
+    WriteRandomPages(1);
+    VMcompact(NUM_FRAMES * NUM_FRAMES);
+    CheckLayout(false);
+    assert(VMcompact(NUM_FRAMES * NUM_FRAMES) == 0);
+    CheckContents();
+
+    // holes left by DONTNEED are filled from the top
+    std::mt19937_64 rng(2);
+    for (uint64_t i = 0; i < NUM_FRAMES; ++i) {
+        uint64_t page = rng() % NUM_PAGES;
+        assert(VMadvise(page * PAGE_SIZE, PAGE_SIZE, VM_ADVICE_DONTNEED) == 1);
+        expected[page] = 0;
+    }
+    VMcompact(NUM_FRAMES * NUM_FRAMES);
+    CheckLayout(true);
+    CheckContents();
+
+    // steps on faults keep the contents intact
+    VMsetCompactionInterval(1);
+    WriteRandomPages(3);
+    CheckContents();
+    VMsetCompactionInterval(0);
+
+    printf("success\n");
+
+    return 0;
+}
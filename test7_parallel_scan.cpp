@@ -0,0 +1,60 @@
+#include "VirtualMemory.h"
+#include "PhysicalMemory.h"
+#include "VirtualMemoryInternal.h"
+
+#include <cstdio>
+#include <cassert>
+#include <random>
+
+const unsigned MAX_THREADS = 8;
+
+// the parallel scan finds the same frames, pages and parents as the
+// sequential one, for any number of threads
+void CheckScans() {
+    VMsetScanThreads(1);
+    FrameScan sequential;
+    ScanUsedFramesForEvict(0, sequential);
+
+    for (unsigned threads = 2; threads <= MAX_THREADS; ++threads) {
+        FrameScan parallel;
+        ParallelScanUsedFrames(0, parallel, threads);
+        assert(parallel.used_frames == sequential.used_frames);
+        assert(parallel.leaf_frames == sequential.leaf_frames);
+        assert(parallel.empty_tables == sequential.empty_tables);
+        assert(parallel.max_frame == sequential.max_frame);
+        for (uint64_t f = 0; f < NUM_FRAMES; ++f) {
+            if (sequential.used_frames[f]) {
+                assert(parallel.parent_entry[f] == sequential.parent_entry[f]);
+            }
+            if (sequential.leaf_frames[f]) {
+                assert(parallel.page_per_frame[f] == sequential.page_per_frame[f]);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    VMinitialize();
+    CheckScans();
+
+    std::mt19937_64 rng(1);
+    for (uint64_t i = 0; i < 4 * NUM_FRAMES; ++i) {
+        uint64_t page = rng() % NUM_PAGES;
+        VMwrite(page * PAGE_SIZE, page);
+        if (i % NUM_FRAMES == 0) {
+            CheckScans();
+        }
+    }
+    CheckScans();
+
+    // dropped pages leave empty tables behind
+    for (uint64_t i = 0; i < NUM_FRAMES; ++i) {
+        uint64_t page = rng() % NUM_PAGES;
+        VMadvise(page * PAGE_SIZE, PAGE_SIZE, VM_ADVICE_DONTNEED);
+    }
+    CheckScans();
+
+    printf("success\n");
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include "VirtualMemory.h"
+#include "PhysicalMemory.h"
+#include "VirtualMemoryInternal.h"
+
+#include <cstdio>
+#include <cassert>
+#include <random>
+#include <vector>
+
+const uint64_t WORKING_SET_PAGES = 4 * NUM_FRAMES < NUM_PAGES ? 4 * NUM_FRAMES : NUM_PAGES;
+const uint64_t ACCESSES = 20000;
+const uint64_t LOW = NUM_FRAMES / 16 > 0 ? NUM_FRAMES / 16 : 1;
+const uint64_t HIGH = NUM_FRAMES / 4;
+
+// value each page should read back
+std::vector<word_t> expected(NUM_PAGES, 0);
+
+// random reads and writes over the working set, every read checked
+void MixedAccesses(uint64_t seed, bool check_free_frames) {
+    std::mt19937_64 rng(seed);
+    for (uint64_t i = 0; i < ACCESSES; ++i) {
+        uint64_t page = rng() % WORKING_SET_PAGES;
+        uint64_t faults = VMfaultCount();
+        if (rng() % 2) {
+            word_t value = word_t(rng() % 1000);
+            VMwrite(page * PAGE_SIZE, value);
+            expected[page] = value;
+        } else {
+            word_t value;
+            VMread(page * PAGE_SIZE, &value);
+            assert(value == expected[page]);
+        }
+        // a batch refill tops the free frames up to HIGH, the faults take
+        // them one by one until fewer than LOW are left
+        if (check_free_frames && VMfaultCount() != faults) {
+            uint64_t free_frames = CurrentVMState().free_frames.size();
+            assert(free_frames + 1 >= LOW && free_frames < HIGH);
+        }
+    }
+}
+
+void CheckContents() {
+    for (uint64_t page = 0; page < WORKING_SET_PAGES; ++page) {
+        word_t value;
+        VMread(page * PAGE_SIZE, &value);
+        assert(value == expected[page]);
+    }
+}
+
+// an instance with a running reclaimer stops it when it is destroyed
+void DestroyWithReclaimer() {
+    VMInstance* instance = VMcreateInstance(NUM_FRAMES);
+    VMsetInstance(instance);
+    assert(VMsetWatermarks(LOW, HIGH) == 1);
+    VMstartReclaimer();
+    for (uint64_t page = 0; page < WORKING_SET_PAGES; ++page) {
+        VMwrite(page * PAGE_SIZE, page + 1);
+    }
+    for (uint64_t page = 0; page < WORKING_SET_PAGES; ++page) {
+        word_t value;
+        VMread(page * PAGE_SIZE, &value);
+        assert(uint64_t(value) == page + 1);
+    }
+    VMsetInstance(nullptr);
+    VMdestroyInstance(instance);
+}
+
+int main(int argc, char **argv) {
+    VMinitialize();
+
+    assert(VMsetWatermarks(2, 1) == 0);
+    assert(VMsetWatermarks(LOW, NUM_FRAMES / 2 + 1) == 0);
+    assert(VMsetWatermarks(LOW, HIGH) == 1);
+
+    // the faulting access refills the free frames in batches
+    MixedAccesses(1, true);
+    CheckContents();
+
+    // the same with a background thread doing the refill. starting and
+    // stopping twice does nothing
+    VMstartReclaimer();
+    VMstartReclaimer();
+    MixedAccesses(2, false);
+    VMstopReclaimer();
+    VMstopReclaimer();
+    CheckContents();
+
+    // the smaller test geometries are below the minimum size of an instance
+    if (NUM_FRAMES >= 2 * (TABLES_DEPTH + 1)) {
+        DestroyWithReclaimer();
+    }
+
+    printf("success\n");
+
+    return 0;
+}